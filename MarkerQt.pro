@@ -23,7 +23,20 @@ HEADERS += base.h \
     worker.h \
     ffmpegdriver.h \
     videostream.h \
-    cornergrabber.h
+    cornergrabber.h \
+    shapemodel.h \
+    tiledimageitem.h \
+    detectioncache.h \
+    batchjob.h \
+    annotationio.h \
+    batchrunner.h \
+    dlibimage.h \
+    engines.h \
+    chipexport.h \
+    imagerotate.h \
+    overlay.h \
+    videoencoder.h \
+    videoexport.h
 
 SOURCES += mainwindow.cpp \
     renderarea.cpp \
@@ -32,13 +45,27 @@ SOURCES += mainwindow.cpp \
     markerqt.cpp \
     ffmpegdriver.cpp \
     videostream.cpp \
-    cornergrabber.cpp
+    cornergrabber.cpp \
+    shapemodel.cpp \
+    tiledimageitem.cpp \
+    detectioncache.cpp \
+    batchjob.cpp \
+    annotationio.cpp \
+    batchrunner.cpp \
+    engines.cpp \
+    chipexport.cpp \
+    imagerotate.cpp \
+    overlay.cpp \
+    videoencoder.cpp \
+    videoexport.cpp
 
 QT += widgets
 
 win32:CONFIG(release, debug|release): LIBS += -L$$PWD/../dlib-19.7/build/vc2017/dlib/release/ -ldlib
 else:win32:CONFIG(debug, debug|release): LIBS += -L$$PWD/../dlib-19.7/build/vc2017/dlib/debug/ -ldlib
 
+win32: LIBS += -lpsapi
+
 INCLUDEPATH += $$PWD/../dlib-19.7
 DEPENDPATH += $$PWD/../dlib-19.7
 
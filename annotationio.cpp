@@ -0,0 +1,48 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "annotationio.h"
+#include <cstdio>
+#include <iterator>
+#include <regex>
+#include <string>
+
+void writePts(std::ostream &os, const CPointFArray &pts) {
+    os << "x, y" << std::endl;
+    for (auto it = std::cbegin(pts); it != std::cend(pts); ++it) {
+        os << it->x() << ", " << it->y() << std::endl;
+    }
+}
+
+void writeRects(std::ostream &os, const CRectArray &rects) {
+    os << "x, y, w, h" << std::endl;
+    for (auto it = std::cbegin(rects); it != std::cend(rects); ++it) {
+        os << it->left() << ", " << it->top() << ", " << it->width() << ", " << it->height() << std::endl;
+    }
+}
+
+bool readPts(std::istream &is, CPointFArray &pts) {
+    std::string parse_templ("%lf %lf"), str;
+    if (!std::getline(is, str)) {
+        return false;
+    }
+    qreal x{}, y{};
+    if (std::regex_match(str, std::regex("x, +y"))) {
+        parse_templ = "%lf, %lf";
+    }
+    else if (!std::regex_match(str, std::regex("x +y"))) {
+        if (2 != std::sscanf(str.c_str(), parse_templ.c_str(), &x, &y)) {
+            return false;
+        }
+        pts.emplace_back(x, y);
+    }
+    while (std::getline(is, str)) {
+        if (2 != std::sscanf(str.c_str(), parse_templ.c_str(), &x, &y)) {
+            return false;
+        }
+        pts.emplace_back(x, y);
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef ANNOTATIONIO_H
+#define ANNOTATIONIO_H
+
+#include "base.h"
+#include <istream>
+#include <ostream>
+
+// .pts landmarks and .txt rectangles, the formats written by File > Export
+void writePts(std::ostream &os, const CPointFArray &pts);
+void writeRects(std::ostream &os, const CRectArray &rects);
+// accepts "x, y" and "x y" headers as well as a headerless list
+bool readPts(std::istream &is, CPointFArray &pts);
+
+#endif // ANNOTATIONIO_H
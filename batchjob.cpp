@@ -0,0 +1,93 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "batchjob.h"
+#include "detectioncache.h"
+#include "imagerotate.h"
+#include "videostream.h"
+#include "worker.h"
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <iostream>
+
+void BatchTask::detect(const QImage &img, double scale, CRectArray &faces, CPointFArray &points)
+{
+    faces = findFaces(img, scale);
+    points.clear();
+    for (const auto &r : faces) {
+        const CPointFArray pts{findLandmarks(img, r)};
+        points.insert(points.end(), pts.cbegin(), pts.cend());
+    }
+}
+
+BatchJob::BatchJob(const QString &fname, int64_t startPts, int frames, double scale) : _fname(fname), _startPts(startPts), _frames(frames), _scale(scale)
+{ }
+
+void BatchJob::cancel()
+{
+    _bCancel.store(true, std::memory_order_relaxed);
+}
+
+void BatchJob::process()
+{
+    QElapsedTimer timer;
+    timer.start();
+    _done = 0;
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, _threads > 0 ? _threads : QThread::idealThreadCount()));
+    // bounds the number of decoded frames waiting for a detection thread
+    QSemaphore inFlight(2 * pool.maxThreadCount());
+
+    VideoStream stream(_fname.toStdString().c_str());
+    stream.setRotation(_turns);
+    stream.seekTo(_startPts);
+    // HOG only finds upright faces, frames are decoded straight into the view's orientation
+    const QSize size{static_cast<int>(stream.getWidth()), static_cast<int>(stream.getHeight())};
+    const QSize upright{0 != (_turns & 1) ? size.transposed() : size};
+    int submitted{};
+    while (submitted < _frames && !_bCancel.load(std::memory_order_relaxed)) {
+        QImage img(upright, QImage::Format::Format_RGB32);
+        if (!stream.getNextFrame(img)) {
+            break;
+        }
+        if (stream.getPts() < _startPts) {
+            continue;
+        }
+        if (stream.getPts() >= _endPts) {
+            break;
+        }
+        const qint64 pts{stream.getPts()};
+        const QString frameKey{DetectionCache::videoKey(_fname, pts)};
+        inFlight.acquire();
+        pool.start(new BatchTask([this, img, pts, frameKey, upright, &inFlight]{
+            if (!_bCancel.load(std::memory_order_relaxed)) {
+                CRectArray faces;
+                CPointFArray points;
+                BatchTask::detect(img, _scale, faces, points);
+                emit frameImage(img, pts, faces, points);
+                if (0 != _turns) {
+                    std::transform(faces.cbegin(), faces.cend(), faces.begin(), [this, &upright](const auto &e){ return rotateRect(e, upright, 4 - _turns); });
+                    std::transform(points.cbegin(), points.cend(), points.begin(), [this, &upright](const auto &e){ return rotatePoint(e, upright, 4 - _turns); });
+                }
+                emit frameDone(frameKey, pts, faces, points);
+                emit progress(++_done);
+            }
+            inFlight.release();
+        }));
+        ++submitted;
+    }
+    pool.waitForDone();
+
+    const int done{_done.load()};
+    const double seconds{timer.elapsed() / 1000.};
+    std::cout << "Batch: " << done << " frames in " << seconds << " s, " << (seconds > 0. ? done / seconds : 0.) << " fps" << std::endl;
+    emit finished(done, seconds);
+}
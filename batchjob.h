@@ -0,0 +1,82 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef BATCHJOB_H
+#define BATCHJOB_H
+
+#include "base.h"
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+
+class QImage;
+
+class BatchTask : public QRunnable
+{
+public:
+    explicit BatchTask(const std::function<void()> &fn) : _fn(fn)
+    { }
+    void run() Q_DECL_OVERRIDE {
+        _fn();
+    }
+
+    // faces and the landmarks of every face, one after another
+    static void detect(const QImage &img, double scale, CRectArray &faces, CPointFArray &points);
+
+private:
+    std::function<void()> _fn;
+};
+
+// Faces and landmarks over a frame range of a video, decoding runs on the
+// job's own thread and feeds a pool of detection threads
+class BatchJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    BatchJob(const QString &fname, int64_t startPts, int frames, double scale);
+    void cancel();
+    void setThreadCount(int threads) {
+        _threads = threads;
+    }
+    // the job also stops at the first frame at or after endPts, frame counts of a
+    // container are only estimates and must not decide where a shard ends
+    void setEndPts(int64_t endPts) {
+        _endPts = endPts;
+    }
+    // frames are detected turned clockwise by quarterTurns * 90 degrees, as the view shows them
+    void setRotation(int quarterTurns) {
+        _turns = quarterTurns & 3;
+    }
+
+public slots:
+    void process();
+
+signals:
+    void progress(int frames);
+    // coordinates are mapped back to the unrotated frame, as DetectionCache stores them
+    void frameDone(const QString &frameKey, qint64 pts, const CRectArray &faces, const CPointFArray &points);
+    // the turned frame with coordinates in it, emitted on the detection thread;
+    // connect directly to keep frames from piling up in a queue
+    void frameImage(const QImage &img, qint64 pts, const CRectArray &faces, const CPointFArray &points);
+    void finished(int frames, double seconds);
+
+private:
+    QString _fname;
+    int64_t _startPts;
+    int64_t _endPts = std::numeric_limits<int64_t>::max();
+    int _frames;
+    double _scale;
+    int _threads{};
+    int _turns{};
+    std::atomic<bool> _bCancel{false};
+    std::atomic<int> _done{0};
+};
+
+#endif // BATCHJOB_H
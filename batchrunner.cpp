@@ -0,0 +1,446 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "batchrunner.h"
+#include "annotationio.h"
+#include "batchjob.h"
+#include "chipexport.h"
+#include "engines.h"
+#include "ffmpegdriver.h"
+#include "videostream.h"
+#include "worker.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QProcess>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+
+constexpr int MaxRestarts{2};
+// detection scales compared by the benchmark, the first one is the reference
+constexpr double BenchmarkScales[]{1., .5, .25};
+// a face counts as found again when it overlaps the reference face at least this much
+constexpr double MinRecallIou{.5};
+
+// one line of the frame listing, order is the pts or the position in the file list
+struct Entry {
+    qint64 order;
+    QString name;
+    int faces;
+};
+using EntryArray = std::vector<Entry>;
+
+// written through QSaveFile, so a worker killed mid-write leaves no half file behind
+bool writeResults(const QString &base, const CRectArray &faces, const CPointFArray &points) {
+    std::ostringstream pts, rects;
+    writePts(pts, points);
+    writeRects(rects, faces);
+    QSaveFile ptsFile(base + QStringLiteral(".pts")), rectFile(base + QStringLiteral(".txt"));
+    if (!ptsFile.open(QIODevice::WriteOnly) || !rectFile.open(QIODevice::WriteOnly)
+        || ptsFile.write(pts.str().c_str()) < 0 || rectFile.write(rects.str().c_str()) < 0
+        || !ptsFile.commit() || !rectFile.commit()) {
+        std::cout << "Could not write " << base.toStdString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool writeEntries(const QString &fname, EntryArray &entries) {
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.order < b.order; });
+    QSaveFile file(fname);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        std::cout << "Could not write " << fname.toStdString() << std::endl;
+        return false;
+    }
+    QTextStream ts(&file);
+    for (const auto &e : entries) {
+        ts << e.order << ", " << e.name << ", " << e.faces << "\n";
+    }
+    ts.flush();
+    return file.commit();
+}
+
+bool readEntries(const QString &fname, EntryArray &entries) {
+    QFile file(fname);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream ts(&file);
+    while (!ts.atEnd()) {
+        const QStringList fields{ts.readLine().split(QStringLiteral(", "))};
+        if (3 == fields.size()) {
+            entries.push_back(Entry{fields[0].toLongLong(), fields[1], fields[2].toInt()});
+        }
+    }
+    return true;
+}
+
+// the suffix is kept, a.jpg and a.png next to each other must not share results
+QString inputBase(const QFileInfo &fi) {
+    return fi.isDir() ? QDir(fi.absoluteFilePath()).dirName() : fi.fileName();
+}
+
+QString shardName(const QDir &out, const QFileInfo &fi, int shard, int shards) {
+    return out.filePath(QStringLiteral("%1.shard%2of%3").arg(inputBase(fi)).arg(shard).arg(shards));
+}
+
+QStringList imageFiles(const QDir &in) {
+    return in.entryList({QStringLiteral("*.jpg"), QStringLiteral("*.jpeg"), QStringLiteral("*.png"), QStringLiteral("*.bmp")}, QDir::Files, QDir::Name);
+}
+
+QImage loadImage(const QString &fname) {
+    QImageReader reader(fname);
+    reader.setAutoTransform(true);
+    QImage img{reader.read()};
+    if (img.isNull()) {
+        std::cout << "Cannot load " << fname.toStdString() << ": " << reader.errorString().toStdString() << std::endl;
+    }
+    // the detectors read opaque 32-bit pixels in place, images with alpha are converted like in TWorker::setData
+    return img.isNull() || (32 == img.depth() && !img.hasAlphaChannel()) ? img : img.convertToFormat(QImage::Format_RGB32);
+}
+
+// mean point distance relative to the outer eye corners of a 68 point shape, or to the face width
+double shapeError(const CPointFArray &pts, const CPointFArray &ref, const QRect &face) {
+    if (pts.size() != ref.size() || ref.empty()) {
+        return -1.;
+    }
+    const QPointF eyes{68 == ref.size() ? ref[45] - ref[36] : QPointF(face.width(), 0.)};
+    const double norm{std::max(1., std::hypot(eyes.x(), eyes.y()))};
+    double sum{};
+    for (size_t i{}; i < pts.size(); ++i) {
+        const QPointF d{pts[i] - ref[i]};
+        sum += std::hypot(d.x(), d.y());
+    }
+    return sum / pts.size() / norm;
+}
+
+// chips get a directory of their own, their .pts never mix with the frame results
+QDir chipDir(const QDir &out) {
+    return QDir(out.filePath(QStringLiteral("chips")));
+}
+
+double intersectionOverUnion(const QRect &a, const QRect &b) {
+    const QRect common{a.intersected(b)};
+    const double inter{static_cast<double>(common.width()) * common.height()};
+    const double uni{static_cast<double>(a.width()) * a.height() + static_cast<double>(b.width()) * b.height() - inter};
+    return common.isEmpty() || uni <= 0. ? 0. : inter / uni;
+}
+
+bool writeFrame(const QDir &out, const QString &name, const QImage &img, const CRectArray &faces, const CPointFArray &points, const BatchOptions &opt) {
+    return writeResults(out.filePath(name), faces, points)
+        && (opt.chipSize <= 0 || writeFaceChips(img, faces, points, chipDir(out).filePath(name), opt.chipSize, opt.chipPadding));
+}
+
+// a subdirectory by default, hand-made .pts files next to the images are never overwritten
+QDir outputDir(const QFileInfo &fi, const QString &outDir) {
+    return QDir(outDir.isEmpty() ? QDir(fi.isDir() ? fi.absoluteFilePath() : fi.absolutePath()).filePath(QStringLiteral("markerqt")) : outDir);
+}
+
+bool runImages(const QDir &in, const QDir &out, const BatchOptions &opt, int shard, int shards, EntryArray &entries) {
+    const QStringList files{imageFiles(in)};
+    std::atomic<int> failed{0};
+    std::mutex guard;
+    QElapsedTimer timer;
+    timer.start();
+    QThreadPool pool;
+    if (opt.threads > 0) {
+        pool.setMaxThreadCount(opt.threads);
+    }
+    int count{};
+    for (int i{shard}; i < files.size(); i += shards, ++count) {
+        const QString name{files[i]};
+        pool.start(new BatchTask([&in, &out, &opt, &failed, &guard, &entries, name, i]{
+            const QImage img{loadImage(in.filePath(name))};
+            if (img.isNull()) {
+                ++failed;
+                return;
+            }
+            CRectArray faces;
+            CPointFArray points;
+            BatchTask::detect(img, opt.scale, faces, points);
+            if (!writeFrame(out, name, img, faces, points, opt)) {
+                ++failed;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(guard);
+            entries.push_back(Entry{i, name, static_cast<int>(faces.size())});
+        }));
+    }
+    pool.waitForDone();
+    const double seconds{timer.elapsed() / 1000.};
+    std::cout << "Batch: " << count << " images, " << failed << " failed, " << seconds << " s" << std::endl;
+    return 0 == failed;
+}
+
+bool runVideo(const QFileInfo &in, const QDir &out, const BatchOptions &opt, int shard, int shards, EntryArray &entries) {
+    if (!AVFormatDll::getInstance().isInited()) {
+        std::cout << "FFmpeg libraries are not available" << std::endl;
+        return false;
+    }
+    AVFormatDll::getInstance().p_av_register_all();
+    // anything that is not a directory is taken for a video, so refuse what FFmpeg cannot open
+    const VideoStream probe(in.absoluteFilePath().toStdString().c_str());
+    if (!probe.isValid()) {
+        std::cout << "Cannot open video " << in.absoluteFilePath().toStdString() << std::endl;
+        return false;
+    }
+    int64_t startPts{}, endPts{std::numeric_limits<int64_t>::max()};
+    if (shards > 1) {
+        // contiguous pts ranges, BatchJob seeks to the key frame before each start. The frame
+        // count only places the bounds: each shard ends where the next begins and the last
+        // one runs to the end, so a wrong estimate moves work between shards but never
+        // duplicates or drops frames
+        const size_t total{probe.getFramesCount()};
+        if (0 == total) {
+            std::cout << "Frame count unknown, shard 0 takes the whole video" << std::endl;
+            if (0 != shard) {
+                return true;
+            }
+        }
+        else {
+            const size_t first{total * shard / shards}, last{total * (shard + 1) / shards};
+            startPts = probe.getFramePts(first);
+            if (shard + 1 < shards) {
+                endPts = probe.getFramePts(last);
+            }
+        }
+    }
+    BatchJob job(in.absoluteFilePath(), startPts, std::numeric_limits<int>::max(), opt.scale);
+    job.setEndPts(endPts);
+    job.setThreadCount(opt.threads);
+    std::atomic<int> failed{0};
+    std::mutex guard;
+    const QString base{inputBase(in)};
+    // no context object, so results are written on the detecting thread
+    QObject::connect(&job, &BatchJob::frameImage, [&out, &opt, &failed, &guard, &entries, &base](const QImage &img, qint64 pts, const CRectArray &faces, const CPointFArray &points) {
+        const QString name{QStringLiteral("%1_%2").arg(base).arg(pts)};
+        if (!writeFrame(out, name, img, faces, points, opt)) {
+            ++failed;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(guard);
+        entries.push_back(Entry{pts, name, static_cast<int>(faces.size())});
+    });
+    job.process();
+    return 0 == failed;
+}
+
+} // namespace unnamed
+
+int runBatch(const QString &input, const BatchOptions &opt, int shard, int shards) {
+    const QFileInfo fi(input);
+    if (!fi.exists()) {
+        std::cout << "No such file or directory " << input.toStdString() << std::endl;
+        return 1;
+    }
+    const QDir out{outputDir(fi, opt.outDir)};
+    if (!QDir().mkpath(opt.chipSize > 0 ? chipDir(out).absolutePath() : out.absolutePath())) {
+        std::cout << "Could not create " << out.absolutePath().toStdString() << std::endl;
+        return 1;
+    }
+    EntryArray entries;
+    const bool bOk{fi.isDir() ? runImages(QDir(fi.absoluteFilePath()), out, opt, shard, shards, entries)
+                              : runVideo(fi, out, opt, shard, shards, entries)};
+    if (!bOk) {
+        return 1;
+    }
+    // the shard listing is only written once every frame of the shard is on disk
+    const QString listing{shards > 1 ? shardName(out, fi, shard, shards) : out.filePath(inputBase(fi) + QStringLiteral(".index"))};
+    return writeEntries(listing, entries) ? 0 : 1;
+}
+
+int runShards(const QString &input, const BatchOptions &opt, int shards) {
+    const QFileInfo fi(input);
+    const QDir out{outputDir(fi, opt.outDir)};
+    if (!fi.exists() || (!out.exists() && !QDir().mkpath(out.absolutePath()))) {
+        std::cout << "Cannot run batch on " << input.toStdString() << std::endl;
+        return 1;
+    }
+    const int workerThreads{opt.threads > 0 ? opt.threads : std::max(1, QThread::idealThreadCount() / shards)};
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<std::unique_ptr<QProcess>> workers(shards);
+    std::vector<int> restarts(shards);
+    auto start = [&](int i) {
+        workers[i].reset(new QProcess());
+        workers[i]->setProcessChannelMode(QProcess::ForwardedChannels);
+        workers[i]->start(QCoreApplication::applicationFilePath(), {
+            QStringLiteral("--batch"), fi.absoluteFilePath(),
+            QStringLiteral("--output"), out.absolutePath(),
+            QStringLiteral("--scale"), QString::number(opt.scale),
+            QStringLiteral("--chips"), QString::number(opt.chipSize),
+            QStringLiteral("--padding"), QString::number(opt.chipPadding),
+            QStringLiteral("--threads"), QString::number(workerThreads),
+            QStringLiteral("--landmarks"), landmarkEngineSelection(),
+            QStringLiteral("--shard"), QStringLiteral("%1/%2").arg(i).arg(shards)});
+    };
+    for (int i{}; i < shards; ++i) {
+        if (QFileInfo::exists(shardName(out, fi, i, shards))) {
+            std::cout << "Shard " << i << " already done" << std::endl;
+        }
+        else {
+            start(i);
+        }
+    }
+    bool bOk{true};
+    for (int i{}; i < shards; ++i) {
+        while (workers[i]) {
+            // a worker that never started has no exit code to look at
+            const bool bFinished{workers[i]->waitForFinished(-1) && QProcess::FailedToStart != workers[i]->error()};
+            if (bFinished && QProcess::NormalExit == workers[i]->exitStatus() && 0 == workers[i]->exitCode()) {
+                workers[i].reset();
+            }
+            else if (restarts[i]++ < MaxRestarts) {
+                std::cout << "Shard " << i << " failed, restarting" << std::endl;
+                start(i);
+            }
+            else {
+                std::cout << "Shard " << i << " failed" << std::endl;
+                workers[i].reset();
+                bOk = false;
+            }
+        }
+    }
+    if (!bOk) {
+        // finished shard listings stay on disk, a rerun only redoes the failed ones
+        return 1;
+    }
+
+    EntryArray entries;
+    for (int i{}; i < shards; ++i) {
+        if (!readEntries(shardName(out, fi, i, shards), entries)) {
+            // the shard listings are kept, a rerun merges them once they are readable
+            std::cout << "Could not read " << shardName(out, fi, i, shards).toStdString() << std::endl;
+            return 1;
+        }
+    }
+    if (!writeEntries(out.filePath(inputBase(fi) + QStringLiteral(".index")), entries)) {
+        return 1;
+    }
+    for (int i{}; i < shards; ++i) {
+        QFile::remove(shardName(out, fi, i, shards));
+    }
+    std::cout << "Batch: " << shards << " shards, " << entries.size() << " frames, " << timer.elapsed() / 1000. << " s" << std::endl;
+    return 0;
+}
+
+int runBenchmark(const QString &input) {
+    const QDir in(input);
+    const QStringList files{imageFiles(in)};
+    const QStringList names{landmarkEngineNames()};
+    std::vector<const LandmarkEngine*> engines;
+    for (const auto &name : names) {
+        const LandmarkEngine *engine = findLandmarkEngine(name);
+        if (engine->isValid()) {
+            engines.push_back(engine);
+        }
+    }
+    const LandmarkEngine *reference = findLandmarkEngine(QStringLiteral("dlib"));
+    // per engine: fitting time, summed error, faces fitted, faces scored
+    std::vector<double> ms(engines.size()), error(engines.size());
+    std::vector<int> fitted(engines.size()), scored(engines.size());
+    // per detection scale: time, reference faces found again and their summed overlap
+    constexpr size_t ScaleCount{sizeof(BenchmarkScales) / sizeof(BenchmarkScales[0])};
+    std::vector<double> detectMs(ScaleCount), overlap(ScaleCount);
+    std::vector<int> recalled(ScaleCount);
+    int images{}, faceCount{};
+    for (const auto &name : files) {
+        const QImage img{loadImage(in.filePath(name))};
+        if (img.isNull()) {
+            continue;
+        }
+        ++images;
+        QElapsedTimer timer;
+        CRectArray faces;
+        for (size_t j{}; j < ScaleCount; ++j) {
+            timer.start();
+            const CRectArray dets{findFaces(img, BenchmarkScales[j])};
+            detectMs[j] += timer.nsecsElapsed() / 1e6;
+            if (0 == j) {
+                faces = dets;
+            }
+            for (const auto &face : faces) {
+                double best{};
+                for (const auto &d : dets) {
+                    best = std::max(best, intersectionOverUnion(face, d));
+                }
+                if (best >= MinRecallIou) {
+                    ++recalled[j];
+                    overlap[j] += best;
+                }
+            }
+        }
+        faceCount += static_cast<int>(faces.size());
+
+        // hand-placed points next to the image take precedence over the dlib predictor
+        CPointFArray truth;
+        std::ifstream file(in.filePath(QFileInfo(name).completeBaseName() + QStringLiteral(".pts")).toStdString().c_str());
+        if (file.is_open() && !readPts(file, truth)) {
+            truth.clear();
+        }
+        for (const auto &face : faces) {
+            CPointFArray ref;
+            if (!truth.empty()) {
+                const QPointF center{std::accumulate(truth.cbegin(), truth.cend(), QPointF()) / truth.size()};
+                ref = face.contains(center.toPoint()) ? truth : CPointFArray();
+            }
+            else if (reference->isValid()) {
+                ref = reference->fit(img, face);
+            }
+            for (size_t k{}; k < engines.size(); ++k) {
+                timer.restart();
+                const CPointFArray pts{engines[k]->fit(img, face)};
+                ms[k] += timer.nsecsElapsed() / 1e6;
+                ++fitted[k];
+                const double err{shapeError(pts, ref, face)};
+                if (err >= 0.) {
+                    error[k] += err;
+                    ++scored[k];
+                }
+            }
+        }
+    }
+    std::cout << "Benchmark: " << images << " images, " << faceCount << " faces, " << faceEngine().name().toStdString() << " detector" << std::endl;
+    std::cout << "Recall and IoU are against the faces found at full resolution" << std::endl;
+    for (size_t j{}; j < ScaleCount; ++j) {
+        std::cout << std::setw(6) << BenchmarkScales[j] << std::setw(12) << (images ? detectMs[j] / images : 0.) << " ms/image"
+                  << std::setw(10) << (faceCount ? 100. * recalled[j] / faceCount : 0.) << " % recall"
+                  << std::setw(10) << (recalled[j] ? overlap[j] / recalled[j] : 0.) << " IoU" << std::endl;
+    }
+    std::cout << "Error is the mean point distance over the outer eye corner distance, against "
+              << (reference->isValid() ? "the .pts files or the dlib predictor" : "the .pts files") << std::endl;
+    for (size_t k{}; k < engines.size(); ++k) {
+        std::cout << std::setw(6) << engines[k]->name().toStdString() << std::setw(12) << (fitted[k] ? ms[k] / fitted[k] : 0.) << " ms/face";
+        if (scored[k]) {
+            std::cout << std::setw(10) << 100. * error[k] / scored[k] << " % error";
+        }
+        std::cout << std::endl;
+    }
+    return images ? 0 : 1;
+}
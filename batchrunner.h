@@ -0,0 +1,43 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QString>
+
+struct BatchOptions {
+    // defaults to a markerqt subdirectory of the input location
+    QString outDir;
+    double scale = 1.;
+    // 0 uses every core
+    int threads = 0;
+    // side of the aligned face chips written with the results, 0 writes none
+    int chipSize = 0;
+    double chipPadding = .2;
+};
+
+// Headless annotation of an image directory or an .avi file, needs no display.
+// Results go to outDir as <file>.pts / <file>.txt with the image suffix kept,
+// video frames as <file>_<pts>, and <input>.index lists every annotated frame
+// in order with its face count.
+// Face chips, when enabled, go to outDir/chips as <file>_<k>.png / .pts; frames
+// are handled as they are decoded, the clip is never held in memory.
+//
+// With shards > 1 only the shard-th part of the input is annotated and the
+// listing is written to <input>.shard<i>of<N> for runShards to merge.
+int runBatch(const QString &input, const BatchOptions &opt, int shard = 0, int shards = 1);
+
+// Splits the input over worker processes, each running runBatch on one shard.
+// A worker that crashes is restarted, shards finished by an earlier run are kept.
+int runShards(const QString &input, const BatchOptions &opt, int shards);
+
+// Times face detection at full, half and quarter scale with the recall and
+// overlap of the reduced scales, then every available landmark engine on the
+// faces found in the images of a directory with their error against .pts
+// files found next to the images.
+int runBenchmark(const QString &input);
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,72 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "chipexport.h"
+#include "annotationio.h"
+#include "dlibimage.h"
+#include <dlib/array.h>
+#include <dlib/image_transforms/interpolation.h>
+
+#include <QSaveFile>
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+bool writeFaceChips(const QImage &img, const CRectArray &faces, const CPointFArray &points, const QString &base, int size, double padding)
+{
+    if (faces.empty()) {
+        return true;
+    }
+    const size_t parts{points.size() / faces.size()};
+    if ((68 != parts && 5 != parts) || parts * faces.size() != points.size()) {
+        std::cout << "Face chips need 5 or 68 landmarks per face, got " << points.size() << " for " << faces.size() << " faces" << std::endl;
+        return false;
+    }
+    std::vector<dlib::chip_details> chips;
+    chips.reserve(faces.size());
+    for (size_t k{}; k < faces.size(); ++k) {
+        const QRect &r = faces[k];
+        std::vector<dlib::point> pts;
+        pts.reserve(parts);
+        for (size_t i{}; i < parts; ++i) {
+            const QPointF &pt = points[k * parts + i];
+            pts.emplace_back(qRound(pt.x()), qRound(pt.y()));
+        }
+        const dlib::full_object_detection det(dlib::rectangle(r.left(), r.top(), r.right(), r.bottom()), pts);
+        chips.push_back(dlib::get_face_chip_details(det, static_cast<unsigned long>(size), padding));
+    }
+    dlib::array2d<dlib::rgb_pixel> arr;
+    dlib::assign_image(arr, img);
+    dlib::array<dlib::array2d<dlib::rgb_pixel>> crops;
+    dlib::extract_image_chips(arr, chips, crops);
+
+    for (size_t k{}; k < crops.size(); ++k) {
+        const auto &crop = crops[k];
+        QImage chip(static_cast<int>(crop.nc()), static_cast<int>(crop.nr()), QImage::Format_RGB888);
+        for (long y{}; y < crop.nr(); ++y) {
+            std::memcpy(chip.scanLine(y), &crop[y][0], 3 * crop.nc());
+        }
+        const dlib::point_transform_affine toChip{dlib::get_mapping_to_chip(chips[k])};
+        CPointFArray chipPts;
+        chipPts.reserve(parts);
+        for (size_t i{}; i < parts; ++i) {
+            const QPointF &pt = points[k * parts + i];
+            const dlib::dpoint p{toChip(dlib::dpoint(pt.x(), pt.y()))};
+            chipPts.emplace_back(p.x(), p.y());
+        }
+        std::ostringstream os;
+        writePts(os, chipPts);
+
+        const QString name{QStringLiteral("%1_%2").arg(base).arg(k)};
+        QSaveFile pngFile(name + QStringLiteral(".png")), ptsFile(name + QStringLiteral(".pts"));
+        if (!pngFile.open(QIODevice::WriteOnly) || !chip.save(&pngFile, "PNG") || !pngFile.commit()
+            || !ptsFile.open(QIODevice::WriteOnly) || ptsFile.write(os.str().c_str()) < 0 || !ptsFile.commit()) {
+            std::cout << "Could not write " << name.toStdString() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
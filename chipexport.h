@@ -0,0 +1,19 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef CHIPEXPORT_H
+#define CHIPEXPORT_H
+
+#include "base.h"
+#include <QImage>
+#include <QString>
+
+// Aligned face crops in the manner of dlib's extract_image_chips. Every face
+// of the frame is written as <base>_<k>.png with its landmarks mapped into the
+// chip as <base>_<k>.pts. points holds the landmarks of all faces one after
+// another, 5 or 68 per face. Safe to call from any thread.
+bool writeFaceChips(const QImage &img, const CRectArray &faces, const CPointFArray &points, const QString &base, int size, double padding);
+
+#endif // CHIPEXPORT_H
@@ -0,0 +1,67 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "detectioncache.h"
+#include <QHash>
+#include <QImage>
+
+DetectionCache::DetectionCache(int maxFrames) : _faces(maxFrames), _points(maxFrames)
+{ }
+
+bool DetectionCache::findFaces(const QString &key, CRectArray &faces) const {
+    if (const CRectArray *p = _faces.object(key)) {
+        faces = *p;
+        return true;
+    }
+    return false;
+}
+
+bool DetectionCache::findPoints(const QString &key, CPointFArray &points) const {
+    if (const CPointFArray *p = _points.object(key)) {
+        points = *p;
+        return true;
+    }
+    return false;
+}
+
+void DetectionCache::insertFaces(const QString &key, const CRectArray &faces) {
+    if (faces.empty()) {
+        return;
+    }
+    _faces.insert(key, new CRectArray(faces));
+}
+
+void DetectionCache::insertPoints(const QString &key, const CPointFArray &points) {
+    if (points.empty()) {
+        return;
+    }
+    _points.insert(key, new CPointFArray(points));
+}
+
+void DetectionCache::clear() {
+    _faces.clear();
+    _points.clear();
+}
+
+QString DetectionCache::imageKey(const QImage &img) {
+    const uint h{qHashBits(img.constBits(), static_cast<size_t>(img.bytesPerLine()) * img.height())};
+    return QStringLiteral("img:%1x%2:%3").arg(img.width()).arg(img.height()).arg(h, 8, 16, QLatin1Char('0'));
+}
+
+QString DetectionCache::videoKey(const QString &fname, qint64 pts) {
+    return QStringLiteral("%1@%2").arg(fname).arg(pts);
+}
+
+QString DetectionCache::faceKey(const QString &frameKey, double scale) {
+    return QStringLiteral("%1|face|%2").arg(frameKey).arg(scale);
+}
+
+QString DetectionCache::pointsKey(const QString &frameKey, double scale, const QRect &rect, const QString &engine) {
+    return QStringLiteral("%1|lbfr|%2|%3|%4,%5,%6,%7").arg(frameKey).arg(engine).arg(scale).arg(rect.x()).arg(rect.y()).arg(rect.width()).arg(rect.height());
+}
+
+QString DetectionCache::batchPointsKey(const QString &frameKey, double scale, const QString &engine) {
+    return QStringLiteral("%1|batch|%2|%3").arg(frameKey).arg(engine).arg(scale);
+}
@@ -0,0 +1,42 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef DETECTIONCACHE_H
+#define DETECTIONCACHE_H
+
+#include "base.h"
+#include <QCache>
+#include <QString>
+
+class QImage;
+
+// Detector results keyed by frame identity and detector configuration,
+// coordinates are always stored for the unrotated frame. Empty results are
+// not kept: a detector that missed the faces of a sideways frame may well
+// find them once the view is rotated.
+class DetectionCache final {
+public:
+    explicit DetectionCache(int maxFrames = 4096);
+
+    bool findFaces(const QString &key, CRectArray &faces) const;
+    bool findPoints(const QString &key, CPointFArray &points) const;
+    void insertFaces(const QString &key, const CRectArray &faces);
+    void insertPoints(const QString &key, const CPointFArray &points);
+    void clear();
+
+    static QString imageKey(const QImage &img);
+    static QString videoKey(const QString &fname, qint64 pts);
+    static QString faceKey(const QString &frameKey, double scale);
+    // engine is the landmark engine selection the points were fitted with
+    static QString pointsKey(const QString &frameKey, double scale, const QRect &rect, const QString &engine);
+    // points of every face of the frame one after another, as the batch job finds them
+    static QString batchPointsKey(const QString &frameKey, double scale, const QString &engine);
+
+private:
+    QCache<QString, CRectArray> _faces;
+    QCache<QString, CPointFArray> _points;
+};
+
+#endif // DETECTIONCACHE_H
@@ -0,0 +1,75 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef DLIBIMAGE_H
+#define DLIBIMAGE_H
+
+// Lets dlib read a 32-bit QImage in place as BGRA pixels
+#include <QImage>
+#include <dlib/image_processing/generic_image.h>
+#include <dlib/pixel.h>
+
+namespace dlib {
+    struct bgr_alpha_pixel
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                This is a simple struct that represents an BGR colored graphical pixel
+                with an alpha channel.
+        !*/
+
+        bgr_alpha_pixel (
+        ) {}
+
+        bgr_alpha_pixel (
+            unsigned char blue_,
+            unsigned char green_,
+            unsigned char red_,
+            unsigned char alpha_
+        ) : blue(blue_), green(green_), red(red_), alpha(alpha_) {}
+
+        unsigned char blue;
+        unsigned char green;
+        unsigned char red;
+        unsigned char alpha;
+    };
+
+    template <>
+    struct pixel_traits<bgr_alpha_pixel>
+    {
+        const static bool rgb  = false;
+        const static bool rgb_alpha  = true;
+        const static bool grayscale = false;
+        const static bool hsi = false;
+        const static bool lab = false;
+        enum {num = 4};
+        typedef unsigned char basic_pixel_type;
+        static basic_pixel_type min() { return 0;}
+        static basic_pixel_type max() { return 255;}
+        const static bool is_unsigned = true;
+        const static bool has_alpha = true;
+    };
+
+    template <>
+    struct image_traits<QImage>
+    {
+        typedef dlib::bgr_alpha_pixel pixel_type;
+    };
+
+    inline const void* image_data(const QImage &img) {
+        return img.bits();
+    }
+    inline long width_step(const QImage &img) {
+        return img.bytesPerLine();
+    }
+    inline long num_rows(const QImage &img) {
+        return img.height();
+    }
+    inline long num_columns(const QImage &img) {
+        return img.width();
+    }
+} // namespace dlib
+
+#endif // DLIBIMAGE_H
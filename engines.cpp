@@ -0,0 +1,241 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "engines.h"
+#include "dlibimage.h"
+#include "shapemodel.h"
+#include <lbf/lbf.hpp>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/image_processing/shape_predictor.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+namespace
+{
+
+const QString AutoEngine{QStringLiteral("auto")};
+
+class HogFaceEngine : public FaceEngine
+{
+public:
+    HogFaceEngine() : _detector(dlib::get_frontal_face_detector()) {
+        std::cout << "Loading face detector" << std::endl;
+    }
+    QString name() const Q_DECL_OVERRIDE {
+        return QStringLiteral("hog");
+    }
+    bool isValid() const Q_DECL_OVERRIDE {
+        return true;
+    }
+    CRectArray detect(const QImage &img) const Q_DECL_OVERRIDE {
+        // object_detector isn't reentrant, every call scans with its own copy of the prototype
+        dlib::frontal_face_detector detector = _detector;
+        dlib::array2d<dlib::rgb_pixel> arr;
+        dlib::assign_image(arr, img);
+        const std::vector<dlib::rectangle> dets = detector(arr);
+        CRectArray frects;
+        frects.reserve(dets.size());
+        std::transform(dets.cbegin(), dets.cend(), std::back_inserter(frects), [](const auto &e){ return QRect(e.left(), e.top(), e.width(), e.height()); });
+        return frects;
+    }
+
+private:
+    dlib::frontal_face_detector _detector;
+};
+
+class DlibShapeEngine : public LandmarkEngine
+{
+public:
+    DlibShapeEngine() {
+        try {
+            dlib::deserialize("shape_predictor_68_face_landmarks.dat") >> _sp;
+            _bValid = true;
+        }
+        catch (const dlib::serialization_error &e) {
+            std::cout << "Could not load shape predictor: " << e.what() << std::endl;
+        }
+    }
+    QString name() const Q_DECL_OVERRIDE {
+        return QStringLiteral("dlib");
+    }
+    bool isValid() const Q_DECL_OVERRIDE {
+        return _bValid;
+    }
+    CPointFArray fit(const QImage &img, const QRect &rect) const Q_DECL_OVERRIDE {
+        if (!_bValid) {
+            return CPointFArray();
+        }
+        // the predictor samples pixel intensities, it reads the opaque BGRA frame in place
+        const dlib::full_object_detection shape = _sp(img, dlib::rectangle(rect.left(), rect.top(), rect.right(), rect.bottom()));
+        CPointFArray pts;
+        const auto sz{shape.num_parts()};
+        pts.reserve(sz);
+        for (std::remove_const_t<decltype(sz)> i{}; i < sz; ++i) {
+            const auto &pt = shape.part(i);
+            pts.emplace_back(pt.x(), pt.y());
+        }
+        return pts;
+    }
+
+private:
+    dlib::shape_predictor _sp;
+    bool _bValid = false;
+};
+
+class FlatShapeEngine : public LandmarkEngine
+{
+public:
+    FlatShapeEngine() : FlatShapeEngine(QStringLiteral("flat"), QStringLiteral("shape_predictor_68_face_landmarks.bin"), QStringLiteral("--convert-model"))
+    { }
+    QString name() const Q_DECL_OVERRIDE {
+        return _name;
+    }
+    bool isValid() const Q_DECL_OVERRIDE {
+        return _model.isValid();
+    }
+    CPointFArray fit(const QImage &img, const QRect &rect) const Q_DECL_OVERRIDE {
+        return _model.fit(img, rect);
+    }
+
+protected:
+    FlatShapeEngine(const QString &name, const QString &fname, const QString &hint) : _name(name), _model(fname) {
+        if (_model.isValid()) {
+            std::cout << "Shape model " << fname.toStdString() << ": " << _model.getModelSize() << " bytes mapped" << std::endl;
+        }
+        else {
+            std::cout << fname.toStdString() << " not found, run with " << hint.toStdString() << " for fast loading" << std::endl;
+        }
+    }
+
+private:
+    QString _name;
+    ShapeModel _model;
+};
+
+// float16 leaves, half the resident memory of the float model
+class FlatHalfEngine : public FlatShapeEngine
+{
+public:
+    FlatHalfEngine() : FlatShapeEngine(QStringLiteral("flat16"), QStringLiteral("shape_predictor_68_face_landmarks.q16.bin"), QStringLiteral("--convert-model --quantize"))
+    { }
+};
+
+// Local binary features cascade, much faster than the regression trees on one face
+class LbfEngine : public LandmarkEngine
+{
+public:
+    LbfEngine() {
+        std::unique_ptr<std::FILE, decltype(&std::fclose)> fp(std::fopen("ibug_helen_dlib_full_model", "rb"), &std::fclose);
+        if (fp) {
+            _lbfr.Read(fp.get());
+            _bValid = true;
+        }
+        else {
+            std::cout << "Could not load LBF model ibug_helen_dlib_full_model" << std::endl;
+        }
+    }
+    QString name() const Q_DECL_OVERRIDE {
+        return QStringLiteral("lbf");
+    }
+    bool isValid() const Q_DECL_OVERRIDE {
+        return _bValid;
+    }
+    CPointFArray fit(const QImage &img, const QRect &rect) const Q_DECL_OVERRIDE {
+        if (!_bValid) {
+            return CPointFArray();
+        }
+        QImage imgGr = img.convertToFormat(QImage::Format_Grayscale8);
+        const cv::Mat gray(imgGr.height(), imgGr.width(), CV_8UC1, imgGr.bits(), imgGr.bytesPerLine());
+        lbf::BBox bbox(rect.left(), rect.top(), rect.width(), rect.height());
+        cv::Mat res;
+        {
+            // Predict isn't declared const, calls are serialized
+            std::lock_guard<std::mutex> lock(_mutex);
+            res = _lbfr.Predict(gray, bbox);
+        }
+        CPointFArray pts;
+        pts.reserve(res.rows);
+        for (int y(0); y < res.rows; ++y) {
+            pts.emplace_back(res.at<double>(y, 0), res.at<double>(y, 1));
+        }
+        return pts;
+    }
+
+private:
+    mutable lbf::LbfCascador _lbfr;
+    mutable std::mutex _mutex;
+    bool _bValid = false;
+};
+
+// concurrent first callers block until the one loading the model finishes
+template<typename T>
+const T& instance() {
+    static const T engine;
+    return engine;
+}
+
+// index into landmarkEngineNames(), -1 stands for auto
+std::atomic<int> selectedLandmarks{-1};
+
+} // namespace unnamed
+
+QStringList landmarkEngineNames()
+{
+    return {QStringLiteral("flat"), QStringLiteral("dlib"), QStringLiteral("lbf"), QStringLiteral("flat16")};
+}
+
+bool selectLandmarkEngine(const QString &name)
+{
+    const int idx{AutoEngine == name ? -1 : landmarkEngineNames().indexOf(name)};
+    if (AutoEngine != name && (idx < 0 || !findLandmarkEngine(name)->isValid())) {
+        return false;
+    }
+    selectedLandmarks = idx;
+    return true;
+}
+
+QString landmarkEngineSelection()
+{
+    const int idx{selectedLandmarks};
+    return idx < 0 ? AutoEngine : landmarkEngineNames().at(idx);
+}
+
+const FaceEngine& faceEngine()
+{
+    return instance<HogFaceEngine>();
+}
+
+const LandmarkEngine* findLandmarkEngine(const QString &name)
+{
+    switch (landmarkEngineNames().indexOf(name)) {
+    case 0:
+        return &instance<FlatShapeEngine>();
+    case 1:
+        return &instance<DlibShapeEngine>();
+    case 2:
+        return &instance<LbfEngine>();
+    case 3:
+        return &instance<FlatHalfEngine>();
+    default:
+        return nullptr;
+    }
+}
+
+const LandmarkEngine& landmarkEngine()
+{
+    const int idx{selectedLandmarks};
+    if (idx >= 0) {
+        return *findLandmarkEngine(landmarkEngineNames().at(idx));
+    }
+    const LandmarkEngine &flat = instance<FlatShapeEngine>();
+    return flat.isValid() ? flat : instance<DlibShapeEngine>();
+}
@@ -0,0 +1,44 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef ENGINES_H
+#define ENGINES_H
+
+#include "base.h"
+#include <QImage>
+#include <QStringList>
+
+// Face detection backend, detect() is reentrant and expects a 32-bit image
+class FaceEngine
+{
+public:
+    virtual ~FaceEngine() = default;
+    virtual QString name() const = 0;
+    virtual bool isValid() const = 0;
+    virtual CRectArray detect(const QImage &img) const = 0;
+};
+
+// Landmark backend, fit() is reentrant and expects a 32-bit image
+class LandmarkEngine
+{
+public:
+    virtual ~LandmarkEngine() = default;
+    virtual QString name() const = 0;
+    virtual bool isValid() const = 0;
+    virtual CPointFArray fit(const QImage &img, const QRect &rect) const = 0;
+};
+
+// Engines load their models on first use. The landmark selection applies to
+// every job started afterwards; "auto" picks the flat model when it was
+// converted and the dlib shape predictor otherwise. Selecting an engine loads
+// its model and is refused when the model is missing.
+QStringList landmarkEngineNames();
+bool selectLandmarkEngine(const QString &name);
+QString landmarkEngineSelection();
+const FaceEngine& faceEngine();
+const LandmarkEngine& landmarkEngine();
+const LandmarkEngine* findLandmarkEngine(const QString &name);
+
+#endif // ENGINES_H
@@ -33,6 +33,8 @@ AVUtilDll::AVUtilDll() {
         && ((p_av_free = DL_FUNCTION(handle, av_free)) != nullptr)
         && ((p_av_frame_get_best_effort_timestamp = DL_FUNCTION(handle, av_frame_get_best_effort_timestamp)) != nullptr)
         && ((p_av_version_info = DL_FUNCTION(handle, av_version_info)) != nullptr)
+        && ((p_av_frame_get_buffer = DL_FUNCTION(handle, av_frame_get_buffer)) != nullptr)
+        && ((p_av_frame_make_writable = DL_FUNCTION(handle, av_frame_make_writable)) != nullptr)
        )
         bInit = true;
 }
@@ -55,6 +57,14 @@ AVFormatDll::AVFormatDll() {
         && ((p_av_find_best_stream = DL_FUNCTION(handle, av_find_best_stream)) != nullptr)
         && ((p_av_read_frame = DL_FUNCTION(handle, av_read_frame)) != nullptr)
         && ((p_av_seek_frame = DL_FUNCTION(handle, av_seek_frame)) != nullptr)
+        && ((p_avformat_alloc_output_context2 = DL_FUNCTION(handle, avformat_alloc_output_context2)) != nullptr)
+        && ((p_avformat_new_stream = DL_FUNCTION(handle, avformat_new_stream)) != nullptr)
+        && ((p_avformat_free_context = DL_FUNCTION(handle, avformat_free_context)) != nullptr)
+        && ((p_avformat_write_header = DL_FUNCTION(handle, avformat_write_header)) != nullptr)
+        && ((p_av_interleaved_write_frame = DL_FUNCTION(handle, av_interleaved_write_frame)) != nullptr)
+        && ((p_av_write_trailer = DL_FUNCTION(handle, av_write_trailer)) != nullptr)
+        && ((p_avio_open = DL_FUNCTION(handle, avio_open)) != nullptr)
+        && ((p_avio_closep = DL_FUNCTION(handle, avio_closep)) != nullptr)
        )
         bInit = true;
 }
@@ -79,6 +89,11 @@ AVCodecDll::AVCodecDll() {
         && ((p_avcodec_send_packet = DL_FUNCTION(handle, avcodec_send_packet)) != nullptr)
         && ((p_avcodec_flush_buffers = DL_FUNCTION(handle, avcodec_flush_buffers)) != nullptr)
         && ((p_av_init_packet = DL_FUNCTION(handle, av_init_packet)) != nullptr)
+        && ((p_avcodec_find_encoder = DL_FUNCTION(handle, avcodec_find_encoder)) != nullptr)
+        && ((p_avcodec_send_frame = DL_FUNCTION(handle, avcodec_send_frame)) != nullptr)
+        && ((p_avcodec_receive_packet = DL_FUNCTION(handle, avcodec_receive_packet)) != nullptr)
+        && ((p_avcodec_parameters_from_context = DL_FUNCTION(handle, avcodec_parameters_from_context)) != nullptr)
+        && ((p_av_packet_rescale_ts = DL_FUNCTION(handle, av_packet_rescale_ts)) != nullptr)
        )
         bInit = true;
 }
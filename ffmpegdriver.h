@@ -26,6 +26,8 @@ public:
     decltype(av_free) *p_av_free = nullptr;
     decltype(av_frame_get_best_effort_timestamp) *p_av_frame_get_best_effort_timestamp = nullptr;
     decltype(av_version_info) *p_av_version_info = nullptr;
+    decltype(av_frame_get_buffer) *p_av_frame_get_buffer = nullptr;
+    decltype(av_frame_make_writable) *p_av_frame_make_writable = nullptr;
 
     bool isInited() const {
         return bInit;
@@ -48,6 +50,14 @@ public:
     decltype(av_find_best_stream) *p_av_find_best_stream = nullptr;
     decltype(av_read_frame) *p_av_read_frame = nullptr;
     decltype(av_seek_frame) *p_av_seek_frame = nullptr;
+    decltype(avformat_alloc_output_context2) *p_avformat_alloc_output_context2 = nullptr;
+    decltype(avformat_new_stream) *p_avformat_new_stream = nullptr;
+    decltype(avformat_free_context) *p_avformat_free_context = nullptr;
+    decltype(avformat_write_header) *p_avformat_write_header = nullptr;
+    decltype(av_interleaved_write_frame) *p_av_interleaved_write_frame = nullptr;
+    decltype(av_write_trailer) *p_av_write_trailer = nullptr;
+    decltype(avio_open) *p_avio_open = nullptr;
+    decltype(avio_closep) *p_avio_closep = nullptr;
 
     bool isInited() const {
         return bInit;
@@ -73,6 +83,11 @@ public:
     decltype(avcodec_send_packet) *p_avcodec_send_packet = nullptr;
     decltype(avcodec_flush_buffers) *p_avcodec_flush_buffers = nullptr;
     decltype(av_init_packet) *p_av_init_packet = nullptr;
+    decltype(avcodec_find_encoder) *p_avcodec_find_encoder = nullptr;
+    decltype(avcodec_send_frame) *p_avcodec_send_frame = nullptr;
+    decltype(avcodec_receive_packet) *p_avcodec_receive_packet = nullptr;
+    decltype(avcodec_parameters_from_context) *p_avcodec_parameters_from_context = nullptr;
+    decltype(av_packet_rescale_ts) *p_av_packet_rescale_ts = nullptr;
 
     bool isInited() const {
         return bInit;
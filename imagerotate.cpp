@@ -0,0 +1,202 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "imagerotate.h"
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGEROTATE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// 64x64 pixels of source and destination tile fit in L1 together
+constexpr int Tile{64};
+// below this many pixels threads cost more than they save
+constexpr int MinParallelPixels{512 * 512};
+
+#ifdef IMAGEROTATE_SSE2
+inline void transpose4(__m128i &r0, __m128i &r1, __m128i &r2, __m128i &r3) {
+    const __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+    const __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+    r0 = _mm_unpacklo_epi64(t0, t1);
+    r1 = _mm_unpackhi_epi64(t0, t1);
+    r2 = _mm_unpacklo_epi64(t2, t3);
+    r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+inline __m128i load(const uint32_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+inline void store(uint32_t *p, const __m128i v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+#endif
+
+// dst(h - 1 - y, x) = src(x, y); dst is h pixels wide. Source rows [y0, y1) are written.
+void rotate90(const uint32_t *src, const ptrdiff_t srcStride, const int w, const int h, uint32_t *dst, const ptrdiff_t dstStride, const int y0, const int y1) {
+    for (int ty{y0}; ty < y1; ty += Tile) {
+        const int tyEnd{std::min(ty + Tile, y1)};
+        for (int tx{}; tx < w; tx += Tile) {
+            const int txEnd{std::min(tx + Tile, w)};
+            int y{ty};
+#ifdef IMAGEROTATE_SSE2
+            for (; y + 4 <= tyEnd; y += 4) {
+                int x{tx};
+                for (; x + 4 <= txEnd; x += 4) {
+                    // rows in reverse order, so every transposed row comes out right to left
+                    __m128i r0 = load(src + (y + 3) * srcStride + x), r1 = load(src + (y + 2) * srcStride + x);
+                    __m128i r2 = load(src + (y + 1) * srcStride + x), r3 = load(src + y * srcStride + x);
+                    transpose4(r0, r1, r2, r3);
+                    uint32_t *d = dst + x * dstStride + (h - 4 - y);
+                    store(d, r0);
+                    store(d + dstStride, r1);
+                    store(d + 2 * dstStride, r2);
+                    store(d + 3 * dstStride, r3);
+                }
+                for (; x < txEnd; ++x) {
+                    for (int k{}; k < 4; ++k) {
+                        dst[x * dstStride + (h - 1 - y - k)] = src[(y + k) * srcStride + x];
+                    }
+                }
+            }
+#endif
+            for (; y < tyEnd; ++y) {
+                const uint32_t *s = src + y * srcStride;
+                for (int x{tx}; x < txEnd; ++x) {
+                    dst[x * dstStride + (h - 1 - y)] = s[x];
+                }
+            }
+        }
+    }
+}
+
+// dst(y, w - 1 - x) = src(x, y); dst is h pixels wide. Source rows [y0, y1) are written.
+void rotate270(const uint32_t *src, const ptrdiff_t srcStride, const int w, const int h, uint32_t *dst, const ptrdiff_t dstStride, const int y0, const int y1) {
+    Q_UNUSED(h);
+    for (int ty{y0}; ty < y1; ty += Tile) {
+        const int tyEnd{std::min(ty + Tile, y1)};
+        for (int tx{}; tx < w; tx += Tile) {
+            const int txEnd{std::min(tx + Tile, w)};
+            int y{ty};
+#ifdef IMAGEROTATE_SSE2
+            for (; y + 4 <= tyEnd; y += 4) {
+                int x{tx};
+                for (; x + 4 <= txEnd; x += 4) {
+                    __m128i r0 = load(src + y * srcStride + x), r1 = load(src + (y + 1) * srcStride + x);
+                    __m128i r2 = load(src + (y + 2) * srcStride + x), r3 = load(src + (y + 3) * srcStride + x);
+                    transpose4(r0, r1, r2, r3);
+                    uint32_t *d = dst + (w - 1 - x) * dstStride + y;
+                    store(d, r0);
+                    store(d - dstStride, r1);
+                    store(d - 2 * dstStride, r2);
+                    store(d - 3 * dstStride, r3);
+                }
+                for (; x < txEnd; ++x) {
+                    for (int k{}; k < 4; ++k) {
+                        dst[(w - 1 - x) * dstStride + y + k] = src[(y + k) * srcStride + x];
+                    }
+                }
+            }
+#endif
+            for (; y < tyEnd; ++y) {
+                const uint32_t *s = src + y * srcStride;
+                for (int x{tx}; x < txEnd; ++x) {
+                    dst[(w - 1 - x) * dstStride + y] = s[x];
+                }
+            }
+        }
+    }
+}
+
+// dst(w - 1 - x, h - 1 - y) = src(x, y), row by row reversed; rows are already sequential
+void rotate180(const uint32_t *src, const ptrdiff_t srcStride, const int w, const int h, uint32_t *dst, const ptrdiff_t dstStride, const int y0, const int y1) {
+    for (int y{y0}; y < y1; ++y) {
+        const uint32_t *s = src + y * srcStride;
+        uint32_t *d = dst + (h - 1 - y) * dstStride;
+        int x{};
+#ifdef IMAGEROTATE_SSE2
+        for (; x + 4 <= w; x += 4) {
+            store(d + (w - 4 - x), _mm_shuffle_epi32(load(s + x), _MM_SHUFFLE(0, 1, 2, 3)));
+        }
+#endif
+        for (; x < w; ++x) {
+            d[w - 1 - x] = s[x];
+        }
+    }
+}
+
+class BandTask : public QRunnable
+{
+public:
+    BandTask(const std::function<void()> &fn, QSemaphore &done) : _fn(fn), _done(done)
+    { }
+    void run() Q_DECL_OVERRIDE {
+        _fn();
+        _done.release();
+    }
+
+private:
+    std::function<void()> _fn;
+    QSemaphore &_done;
+};
+
+} // namespace unnamed
+
+QImage rotateImage(const QImage &img, int quarterTurns)
+{
+    quarterTurns &= 3;
+    if (img.isNull() || 32 != img.depth() || 0 == quarterTurns) {
+        return img;
+    }
+    const int w{img.width()}, h{img.height()};
+    QImage res(2 == quarterTurns ? QSize(w, h) : QSize(h, w), img.format());
+    const uint32_t *src = reinterpret_cast<const uint32_t*>(img.constBits());
+    uint32_t *dst = reinterpret_cast<uint32_t*>(res.bits());
+    const ptrdiff_t srcStride{img.bytesPerLine() / 4}, dstStride{res.bytesPerLine() / 4};
+    const auto kernel = 1 == quarterTurns ? rotate90 : (2 == quarterTurns ? rotate180 : rotate270);
+
+    // bands of whole tiles write disjoint parts of the destination
+    const int tiles{(h + Tile - 1) / Tile};
+    const int jobs{w * h < MinParallelPixels ? 1 : std::min(tiles, std::max(1, QThread::idealThreadCount()))};
+    auto bandStart = [tiles, jobs, h](int j) { return std::min(h, tiles * j / jobs * Tile); };
+    QSemaphore done;
+    for (int j{1}; j < jobs; ++j) {
+        QThreadPool::globalInstance()->start(new BandTask([=]{ kernel(src, srcStride, w, h, dst, dstStride, bandStart(j), bandStart(j + 1)); }, done));
+    }
+    kernel(src, srcStride, w, h, dst, dstStride, 0, bandStart(1));
+    done.acquire(jobs - 1);
+    return res;
+}
+
+QPointF rotatePoint(const QPointF &p, const QSize &size, int quarterTurns)
+{
+    switch (quarterTurns & 3) {
+    case 1:
+        return QPointF(size.height() - 1 - p.y(), p.x());
+    case 2:
+        return QPointF(size.width() - 1 - p.x(), size.height() - 1 - p.y());
+    case 3:
+        return QPointF(p.y(), size.width() - 1 - p.x());
+    default:
+        return p;
+    }
+}
+
+QRect rotateRect(const QRect &r, const QSize &size, int quarterTurns)
+{
+    return QRect(rotatePoint(QPointF(r.topLeft()), size, quarterTurns).toPoint(), rotatePoint(QPointF(r.bottomRight()), size, quarterTurns).toPoint()).normalized();
+}
@@ -0,0 +1,21 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef IMAGEROTATE_H
+#define IMAGEROTATE_H
+
+#include <QImage>
+
+// Clockwise rotation by quarterTurns * 90 degrees of a 32-bit image. Pixels
+// are moved as raw 32-bit words through cache-sized tiles, with SSE2 4x4
+// transposes where available, and bands of rows run on the global thread pool.
+QImage rotateImage(const QImage &img, int quarterTurns);
+
+// Where the pixel at p of an image of the given size lands after
+// rotateImage(img, quarterTurns); 4 - quarterTurns on the turned size maps back.
+QPointF rotatePoint(const QPointF &p, const QSize &size, int quarterTurns);
+QRect rotateRect(const QRect &r, const QSize &size, int quarterTurns);
+
+#endif // IMAGEROTATE_H
@@ -4,15 +4,23 @@
 **/
 
 #include "mainwindow.h"
+#include "annotationio.h"
+#include "batchjob.h"
+#include "engines.h"
 #include "ffmpegdriver.h"
+#include "imagerotate.h"
 #include "renderarea.h"
+#include "tiledimageitem.h"
+#include "videoexport.h"
 #include "videostream.h"
 #include "worker.h"
 
 #include <QAction>
 #include <QActionGroup>
+#include <QElapsedTimer>
 #include <QFileDialog>
 #include <QImageReader>
+#include <QInputDialog>
 #include <QGraphicsEllipseItem>
 #include <QGraphicsRectItem>
 #include <QGuiApplication>
@@ -22,6 +30,7 @@
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QProgressDialog>
 #include <QSlider>
 #include <QStatusBar>
 #include <QTabBar>
@@ -33,16 +42,49 @@
 #include <cassert>
 #include <fstream>
 #include <functional>
-#include <regex>
 #include <type_traits>
 #include <dlib/revision.h>
 
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#endif
+
 extern const double ZoomInFactor;
 extern const double ZoomOutFactor;
 extern const int ScrollStep;
 
+// full detection runs every KeyFrameInterval frames in tracking mode
+constexpr int KeyFrameInterval{10};
+// stills above this many pixels are shown through a tiled pyramid instead of one pixmap
+constexpr qint64 TiledImagePixels{16 * 1024 * 1024};
+// longest side of the preview such stills open with when their reader can decode regions
+constexpr int PreviewSize{4096};
+
 namespace {
+qint64 peakMemoryMb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc{};
+    return GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)) ? static_cast<qint64>(pmc.PeakWorkingSetSize >> 20) : 0;
+#elif defined(__linux__)
+    rusage usage{};
+    return 0 == getrusage(RUSAGE_SELF, &usage) ? static_cast<qint64>(usage.ru_maxrss >> 10) : 0;
+#else
+    return 0;
+#endif
+}
+
+QRect scaledRect(const QRect &r, double s) {
+    return QRectF(r.x() * s, r.y() * s, r.width() * s, r.height() * s).toRect();
+}
+
 template <typename T> QImage imgRotate(const QImage &img) {
+    if (32 == img.depth()) {
+        return rotateImage(img, T::QuarterTurns);
+    }
     const T r(img.width(), img.height());
     QImage res(r.getSize(), img.format());
     for (decltype(img.height()) y{}; y < img.height(); ++y) {
@@ -56,6 +98,8 @@ template <typename T> QImage imgRotate(const QImage &img) {
 class Rotate90
 {
 public:
+    static constexpr int QuarterTurns{1};
+
     constexpr Rotate90(int w, int h) : w_(w), h_(h)
     { }
     constexpr QSize getSize() const {
@@ -64,6 +108,9 @@ public:
     constexpr QPoint getPoint(const int x, const int y) const {
         return QPoint(h_ - 1 - y, x);
     }
+    constexpr QPointF getPoint(const QPointF &p) const {
+        return QPointF(h_ - 1 - p.y(), p.x());
+    }
 private:
     int w_{}, h_{};
 };
@@ -71,6 +118,8 @@ private:
 class Rotate180
 {
 public:
+    static constexpr int QuarterTurns{2};
+
     constexpr Rotate180(int w, int h) : w_(w), h_(h)
     { }
     constexpr QSize getSize() const {
@@ -79,6 +128,9 @@ public:
     constexpr QPoint getPoint(const int x, const int y) const {
         return QPoint(w_ - 1 - x, h_ - 1 - y);
     }
+    constexpr QPointF getPoint(const QPointF &p) const {
+        return QPointF(w_ - 1 - p.x(), h_ - 1 - p.y());
+    }
 private:
     int w_{}, h_{};
 };
@@ -86,6 +138,8 @@ private:
 class Rotate270
 {
 public:
+    static constexpr int QuarterTurns{3};
+
     constexpr Rotate270(int w, int h) : w_(w), h_(h)
     { }
     constexpr QSize getSize() const {
@@ -94,6 +148,9 @@ public:
     constexpr QPoint getPoint(const int x, const int y) const {
         return QPoint(y, w_ - 1 - x);
     }
+    constexpr QPointF getPoint(const QPointF &p) const {
+        return QPointF(p.y(), w_ - 1 - p.x());
+    }
 private:
     int w_{}, h_{};
 };
@@ -109,10 +166,12 @@ TabWidget::TabWidget(QWidget *parent) : QTabWidget(parent), renderArea(new Rende
 }
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), _gview(new RenderArea(&_scene))/*, renderArea(new RenderArea(&_scene))*/
+    : QMainWindow(parent), _gview(new RenderArea(&_scene))/*, renderArea(new RenderArea(&_scene))*/, _tracker(std::make_shared<FaceTracker>()), _faceJobs(std::make_shared<JobTicket>()), _lbfrJobs(std::make_shared<JobTicket>())
 {
     qRegisterMetaType<CRectArray>("CRectArray&");
     qRegisterMetaType<std::vector<QPointF>>("CPointFArray&");
+    qRegisterMetaType<CRectArray>("CRectArray");
+    qRegisterMetaType<CPointFArray>("CPointFArray");
 
     setCentralWidget(_gview);
     //setCentralWidget(renderArea);
@@ -170,6 +229,36 @@ MainWindow::MainWindow(QWidget *parent)
     rotationGroup->addAction(rotation270Act);
     rotation0Act->setChecked(true);
 
+    QAction *roiAct = new QAction(tr("ROI Detection"), this);
+    roiAct->setCheckable(true);
+    roiAct->setStatusTip(tr("Detect faces only inside rectangles or around the last found faces"));
+    connect(roiAct, &QAction::toggled, this, &MainWindow::sltRoiMode);
+
+    QAction *trackAct = new QAction(tr("Face Tracking"), this);
+    trackAct->setCheckable(true);
+    trackAct->setStatusTip(tr("Track faces between frames, run the full detector every %1 frames").arg(KeyFrameInterval));
+    connect(trackAct, &QAction::toggled, this, &MainWindow::sltTracking);
+
+    QActionGroup *scaleGroup = new QActionGroup(this);
+    for (const auto &e : {std::make_pair(1., tr("Full Resolution")), std::make_pair(.5, tr("1/2")), std::make_pair(.25, tr("1/4"))}) {
+        QAction *scaleAct = scaleGroup->addAction(e.second);
+        scaleAct->setData(e.first);
+        scaleAct->setCheckable(true);
+        scaleAct->setChecked(e.first == _detectionScale);
+    }
+    connect(scaleGroup, &QActionGroup::triggered, this, &MainWindow::sltDetectionScale);
+
+    QActionGroup *engineGroup = new QActionGroup(this);
+    for (const auto &e : {std::make_pair(QStringLiteral("auto"), tr("Automatic")), std::make_pair(QStringLiteral("flat"), tr("Shape Model (.bin)")),
+                          std::make_pair(QStringLiteral("dlib"), tr("dlib Shape Predictor")), std::make_pair(QStringLiteral("lbf"), tr("LBF Cascade")),
+                          std::make_pair(QStringLiteral("flat16"), tr("Shape Model, float16 (.q16.bin)"))}) {
+        QAction *engineAct = engineGroup->addAction(e.second);
+        engineAct->setData(e.first);
+        engineAct->setCheckable(true);
+        engineAct->setChecked(e.first == landmarkEngineSelection());
+    }
+    connect(engineGroup, &QActionGroup::triggered, this, &MainWindow::sltLandmarkEngine);
+
     QMenu *fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(opnAction);
     fileMenu->addSeparator();
@@ -184,6 +273,13 @@ MainWindow::MainWindow(QWidget *parent)
     optMenu->addAction(rotation0Act);
     optMenu->addAction(rotation90Act);
     optMenu->addAction(rotation270Act);
+    optMenu->addSeparator();
+    optMenu->addAction(roiAct);
+    optMenu->addAction(trackAct);
+    QMenu *scaleMenu = optMenu->addMenu(tr("Detection Scale"));
+    scaleMenu->addActions(scaleGroup->actions());
+    QMenu *engineMenu = optMenu->addMenu(tr("Landmark Engine"));
+    engineMenu->addActions(engineGroup->actions());
 
     QMenu *helpMenu = menuBar()->addMenu(tr("&Help"));
     QAction *aboutQtAct = helpMenu->addAction(tr("About &Qt"), qApp, &QApplication::aboutQt);
@@ -207,6 +303,14 @@ MainWindow::MainWindow(QWidget *parent)
     QAction *actNextFrame = new QAction(tr("Next"), this);
     connect(actNextFrame, &QAction::triggered, this, &MainWindow::nextFrame);
     vidToolBar->addAction(actNextFrame);
+    QAction *actBatch = new QAction(tr("Batch..."), this);
+    actBatch->setStatusTip(tr("Detect faces and landmarks on a range of frames"));
+    connect(actBatch, &QAction::triggered, this, &MainWindow::sltBatch);
+    vidToolBar->addAction(actBatch);
+    QAction *actExport = new QAction(tr("Export Video..."), this);
+    actExport->setStatusTip(tr("Write the video with faces and landmarks drawn on every frame"));
+    connect(actExport, &QAction::triggered, this, &MainWindow::sltExportVideo);
+    vidToolBar->addAction(actExport);
 
     QStatusBar *statusBar = QMainWindow::statusBar();
     posLabel = new QLabel();
@@ -221,23 +325,57 @@ MainWindow::~MainWindow()
 {
 }
 
+void MainWindow::warmUp()
+{
+    auto safeWorker = std::make_unique<TWorker>(TWorker::workerType::wtWarmUp);
+    QThread *thread = new QThread();
+    TWorker *worker = safeWorker.release();
+    worker->moveToThread(thread);
+
+    connect(thread, &QThread::started, worker, &TWorker::process);
+    connect(worker, &TWorker::finished, thread, &QThread::quit);
+    connect(worker, &TWorker::finished, worker, &TWorker::deleteLater);
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+
+    thread->start(QThread::LowestPriority);
+}
+
 void MainWindow::loadFile(const QString &filename) {
     if (!filename.isNull()) {
         QFileInfo fi(filename);
         if (0 == fi.completeSuffix().compare("avi")) {
+            _sourceName = fi.absoluteFilePath();
+            _roiFile.clear();
+            _previewScale = 1.;
             _safeStream.reset(new VideoStream(filename.toStdString().c_str()));
             this->nextFrame();
         }
         else {
+            QElapsedTimer timer;
+            timer.start();
             QImageReader reader(filename);
             reader.setAutoTransform(true);
+            // huge stills open as a reduced decode, full resolution regions are read as they come into view
+            const QSize fullSize{reader.size()};
+            const bool bRoi{fullSize.isValid() && static_cast<qint64>(fullSize.width()) * fullSize.height() > TiledImagePixels
+                && reader.supportsOption(QImageIOHandler::ScaledSize) && reader.supportsOption(QImageIOHandler::ClipRect)
+                && QImageIOHandler::TransformationNone == reader.transformation()};
+            if (bRoi) {
+                reader.setScaledSize(fullSize.scaled(PreviewSize, PreviewSize, Qt::KeepAspectRatio));
+            }
             QImage newImage = reader.read();
             if (newImage.isNull()) {
                 QMessageBox::information(this, QGuiApplication::applicationDisplayName(), tr("Cannot load %1: %2").arg(QDir::toNativeSeparators(filename), reader.errorString()));
                 return;
             }
+            _roiFile = bRoi ? fi.absoluteFilePath() : QString();
             _image0 = std::move(newImage);
+            _half0 = QImage();
+            _frameSize = bRoi ? fullSize : _image0.size();
+            _previewScale = static_cast<double>(_image0.width()) / _frameSize.width();
+            _frameKey = DetectionCache::imageKey(_image0);
             this->Rotate();
+            statusBar()->showMessage(tr("%1x%2: first image in %3 ms, peak memory %4 MB").arg(_frameSize.width()).arg(_frameSize.height()).arg(timer.elapsed()).arg(peakMemoryMb()));
             //item->setFlag(QGraphicsItem::GraphicsItemFlag::ItemIsMovable, true);
             //screenCenter = QPointF(image_.width() / 2.f, image_.height() / 2.f);
             //screenScale = std::max(static_cast<decltype(screenScale)>(image_.width()) / this->width(), static_cast<decltype(screenScale)>(image_.height()) / this->height());
@@ -293,6 +431,7 @@ void MainWindow::opnFile()
     /*auto its(_scene.items());
     std::for_each(its.begin(), its.end(), std::bind(&QGraphicsScene::removeItem, &_scene, std::placeholders::_1));*/
     _scene.clear();
+    _imageItem = nullptr;
     _rects.clear();
     ptNum = 0;
     loadFile(filename);
@@ -305,26 +444,10 @@ void MainWindow::impFile()
     if (!filename.isNull()) {
         std::fstream file(filename.toStdString().c_str());
         if (file.is_open()) {
-            std::string parse_templ("%lf %lf"), str;
-            if (std::getline(file, str)) {
-                qreal x{}, y{};
-                if (std::regex_match(str, std::regex("x, +y"))) {
-                    parse_templ = "%lf, %lf";
-                }
-                else if (std::regex_match(str, std::regex("x +y"))) {
-                    (void)parse_templ;
-                }
-                else {
-                    const int r(std::sscanf(str.c_str(), parse_templ.c_str(), &x, &y));
-                    assert(2 == r);
-                    AddPoint(QPointF(x, y));
-                }
-                while (std::getline(file, str)) {
-                    const int r(std::sscanf(str.c_str(), parse_templ.c_str(), &x, &y));
-                    assert(2 == r);
-                    AddPoint(QPointF(x, y));
-                }
-            }
+            CPointFArray pts;
+            const bool bOk{readPts(file, pts)};
+            assert(bOk);
+            showPoints(pts);
             file.close();
         }
     }
@@ -337,18 +460,24 @@ void MainWindow::expFile()
         std::fstream file(filename.toStdString().c_str(), std::fstream::out);
         if (file.is_open()) {
             auto list = _scene.items();
-            std::vector<PointItem*> v;
+            std::vector<std::pair<int, QPointF>> v;
             for (auto it{std::cbegin(list)}; it != std::cend(list); ++it) {
                 if (PointItem::Type == (*it)->type()) {
                     PointItem *p = qgraphicsitem_cast<PointItem*>(*it);
-                    v.push_back(p);
+                    v.emplace_back(p->getNum(), p->pos());
+                }
+                else if (LandmarkSetItem::Type == (*it)->type()) {
+                    LandmarkSetItem *p = qgraphicsitem_cast<LandmarkSetItem*>(*it);
+                    for (size_t i{}; i < p->getPoints().size(); ++i) {
+                        v.emplace_back(p->getNums()[i], p->mapToScene(p->getPoints()[i]));
+                    }
                 }
             }
-            std::sort(std::begin(v), std::end(v), [](const auto &a, const auto &b){ return a->getNum() < b->getNum(); });
-            file << "x, y" << std::endl;
-            for (auto it = std::cbegin(v); it != std::cend(v); ++it) {
-                file << (*it)->x() << ", " << (*it)->y() << std::endl;
-            }
+            std::sort(std::begin(v), std::end(v), [](const auto &a, const auto &b){ return a.first < b.first; });
+            CPointFArray pts;
+            pts.reserve(v.size());
+            std::transform(std::cbegin(v), std::cend(v), std::back_inserter(pts), [](const auto &e){ return e.second; });
+            writePts(file, pts);
             file.close();
         }
     }
@@ -360,15 +489,15 @@ void MainWindow::expRect()
     if (!filename.isNull()) {
         std::fstream file(filename.toStdString().c_str(), std::fstream::out);
         if (file.is_open()) {
-            file << "x, y, w, h" << std::endl;
+            CRectArray rects;
             auto list = _scene.items();
             for (auto it{std::cbegin(list)}; it != std::cend(list); ++it) {
                 if (RectItem::Type == (*it)->type()) {
                     RectItem *p = qgraphicsitem_cast<RectItem*>(*it);
-                    QRect r = p->getRect();
-                    file << r.left() << ", " << r.top() << ", " << r.width() << ", " << r.height() << std::endl;
+                    rects.push_back(p->getRect());
                 }
             }
+            writeRects(file, rects);
             file.close();
         }
     }
@@ -386,10 +515,22 @@ void MainWindow::sltFaceDetector(bool bChecked)
     }*/
 }
 
-void MainWindow::sltFaceDetector(CRectArray &arr)
+void MainWindow::sltFaceDetector(CRectArray &arr, quint64 job)
 {
+    if (!_faceJobs->isCurrent(job)) {
+        return;
+    }
+    if (1. != _previewScale) {
+        std::transform(std::cbegin(arr), std::cend(arr), std::begin(arr), [this](const auto &e){ return scaledRect(e, 1. / _previewScale); });
+    }
+    if (!_faceKey.isEmpty()) {
+        CRectArray stored;
+        stored.reserve(arr.size());
+        std::transform(std::cbegin(arr), std::cend(arr), std::back_inserter(stored), [this](const auto &e){ return fromView(e); });
+        _cache.insertFaces(_faceKey, stored);
+    }
     //std::for_each(std::cbegin(arr), std::cend(arr), [this](const auto &e){ _rects.push_back(_scene.addRect(e, QPen(Qt::red, 2))); _rects.back()->setFlag(QGraphicsItem::GraphicsItemFlag::ItemIsMovable, true); });
-    std::for_each(std::cbegin(arr), std::cend(arr), std::bind(&MainWindow::AddRect, this, std::placeholders::_1));
+    showFaces(arr);
     //_thread.render(screenCenter, screenScale, this->size(), image_, frects, pts);
     //std::copy(std::begin(arr), std::end(arr), std::back_inserter(frects));
     /*if (_bFaceChecked) {
@@ -398,17 +539,62 @@ void MainWindow::sltFaceDetector(CRectArray &arr)
     }*/
 }
 
+void MainWindow::showFaces(const CRectArray &arr)
+{
+    _lastFaces = arr;
+    std::for_each(std::cbegin(arr), std::cend(arr), std::bind(&MainWindow::AddRect, this, std::placeholders::_1));
+}
+
 void MainWindow::fFaceDetector()
 {
+    // ROI results depend on the rectangles in the scene, those are never cached
+    _faceKey = _bRoiMode || _frameKey.isEmpty() ? QString() : DetectionCache::faceKey(_frameKey, _detectionScale);
+    CRectArray faces;
+    if (!_faceKey.isEmpty() && _cache.findFaces(_faceKey, faces)) {
+        _faceJobs->revoke();
+        std::transform(std::cbegin(faces), std::cend(faces), std::begin(faces), [this](const auto &e){ return toView(e); });
+        showFaces(faces);
+        return;
+    }
+
     auto safeWorker = std::make_unique<TWorker>(TWorker::workerType::wtFaceDetector);
     QThread *thread = new QThread();
     TWorker *worker = safeWorker.release();
-    worker->setData(_image);
+    worker->setData(upright());
+    worker->setRegions(detectionRegions());
+    worker->setTicket(_faceJobs);
+    worker->setDetectionScale(_detectionScale, .5 == _detectionScale ? uprightHalf() : QImage());
+    worker->moveToThread(thread);
+
+    connect(thread, &QThread::started, worker, &TWorker::process);
+    connect(worker, &TWorker::finished, thread, &QThread::quit);
+    connect(worker ,&TWorker::completeFaceDetector, this, static_cast<void (MainWindow::*)(CRectArray&, quint64)>(&MainWindow::sltFaceDetector));
+    connect(worker, &TWorker::finished, worker, &TWorker::deleteLater);
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+    connect(worker, &TWorker::noMemory, this, &MainWindow::sltNoMemory);
+
+    thread->start();
+}
+
+void MainWindow::fFaceTracker()
+{
+    _faceKey.clear();
+    const bool bKeyFrame{0 == _framesSinceKey};
+    _framesSinceKey = (_framesSinceKey + 1) % KeyFrameInterval;
+
+    auto safeWorker = std::make_unique<TWorker>(bKeyFrame ? TWorker::workerType::wtFaceDetector : TWorker::workerType::wtFaceTracker);
+    QThread *thread = new QThread();
+    TWorker *worker = safeWorker.release();
+    worker->setData(upright());
+    worker->setRegions(detectionRegions());
+    worker->setTracker(_tracker);
+    worker->setTicket(_faceJobs);
+    worker->setDetectionScale(_detectionScale, .5 == _detectionScale ? uprightHalf() : QImage());
     worker->moveToThread(thread);
 
     connect(thread, &QThread::started, worker, &TWorker::process);
     connect(worker, &TWorker::finished, thread, &QThread::quit);
-    connect(worker ,&TWorker::completeFaceDetector, this, static_cast<void (MainWindow::*)(CRectArray&)>(&MainWindow::sltFaceDetector));
+    connect(worker ,&TWorker::completeFaceDetector, this, static_cast<void (MainWindow::*)(CRectArray&, quint64)>(&MainWindow::sltFaceDetector));
     connect(worker, &TWorker::finished, worker, &TWorker::deleteLater);
     connect(thread, &QThread::finished, thread, &QThread::deleteLater);
     connect(worker, &TWorker::noMemory, this, &MainWindow::sltNoMemory);
@@ -422,34 +608,101 @@ void MainWindow::sltLBFRDetector(bool bChecked)
     fLBFRDetector();
 }
 
-void MainWindow::sltLBFRDetector(CPointFArray &arr)
+void MainWindow::sltLBFRDetector(CPointFArray &arr, quint64 job)
 {
+    if (!_lbfrJobs->isCurrent(job)) {
+        return;
+    }
+    if (1. != _previewScale) {
+        std::transform(std::cbegin(arr), std::cend(arr), std::begin(arr), [this](const auto &e){ return e / _previewScale; });
+    }
+    if (!_lbfrKey.isEmpty()) {
+        CPointFArray stored;
+        stored.reserve(arr.size());
+        std::transform(std::cbegin(arr), std::cend(arr), std::back_inserter(stored), [this](const auto &e){ return fromView(e); });
+        _cache.insertPoints(_lbfrKey, stored);
+    }
     //std::for_each(std::cbegin(arr), std::cend(arr), [this](const auto &e){ _points.push_back(_scene.addEllipse(QRectF(QPointF(e.x() - 2, e.y() - 2), QSizeF(3, 3)), QPen(Qt::red, 2))); _points.back()->setFlag(QGraphicsItem::GraphicsItemFlag::ItemIsMovable, true); });
-    std::for_each(std::cbegin(arr), std::cend(arr), std::bind(&MainWindow::AddPoint, this, std::placeholders::_1));
+    showPoints(arr);
     /*if (_bLBFRChecked) {
         pts = std::move(arr);
         _thread.render(screenCenter, screenScale, this->size(), image_, frects, pts);
     }*/
 }
 
+void MainWindow::showPoints(const CPointFArray &arr, size_t faces)
+{
+    // points that don't split evenly are kept together rather than mixed across faces
+    const size_t parts{faces > 1 && 0 == arr.size() % faces ? arr.size() / faces : arr.size()};
+    for (size_t first{}; first < arr.size(); first += parts) {
+        auto item = std::make_unique<LandmarkSetItem>(CPointFArray(arr.cbegin() + first, arr.cbegin() + first + parts), ptNum);
+        item->setViewScale(_gview->transform().m11());
+        ptNum += static_cast<int>(parts);
+        _scene.addItem(item.release());
+    }
+}
+
+void MainWindow::showCached()
+{
+    if (_frameKey.isEmpty()) {
+        return;
+    }
+    CRectArray faces;
+    if (_cache.findFaces(DetectionCache::faceKey(_frameKey, _detectionScale), faces)) {
+        std::transform(std::cbegin(faces), std::cend(faces), std::begin(faces), [this](const auto &e){ return toView(e); });
+        showFaces(faces);
+    }
+    CPointFArray points;
+    if (_cache.findPoints(DetectionCache::batchPointsKey(_frameKey, _detectionScale, landmarkEngineSelection()), points)) {
+        std::transform(std::cbegin(points), std::cend(points), std::begin(points), [this](const auto &e){ return toView(e); });
+        showPoints(points, faces.size());
+    }
+    else if (_cache.findPoints(DetectionCache::pointsKey(_frameKey, _detectionScale, QRect(), landmarkEngineSelection()), points)) {
+        std::transform(std::cbegin(points), std::cend(points), std::begin(points), [this](const auto &e){ return toView(e); });
+        showPoints(points);
+    }
+}
+
 void MainWindow::fLBFRDetector()
 {
-    auto safeWorker = std::make_unique<TWorker>(TWorker::workerType::wtLBFRDetector);
-    QThread *thread = new QThread();
-    TWorker *worker = safeWorker.release();
-    worker->setData(_image);
-    worker->moveToThread(thread);
+    QRect rect;
     auto items = _scene.items();
     for (auto it{std::cbegin(items)}; it != std::cend(items); ++it) {
         if (RectItem::Type == (*it)->type()) {
-            worker->setRect(qgraphicsitem_cast<RectItem*>(*it)->getRect());
+            rect = qgraphicsitem_cast<RectItem*>(*it)->getRect();
             break;
         }
     }
+    _lbfrKey.clear();
+    if (!_frameKey.isEmpty() && (!rect.isEmpty() || !_bRoiMode)) {
+        const QRect r{rect.isEmpty() ? rect : fromView(rect)};
+        _lbfrKey = DetectionCache::pointsKey(_frameKey, _detectionScale, r, landmarkEngineSelection());
+        CPointFArray points;
+        if (_cache.findPoints(_lbfrKey, points)) {
+            _lbfrJobs->revoke();
+            std::transform(std::cbegin(points), std::cend(points), std::begin(points), [this](const auto &e){ return toView(e); });
+            showPoints(points);
+            return;
+        }
+    }
+
+    auto safeWorker = std::make_unique<TWorker>(TWorker::workerType::wtLBFRDetector);
+    QThread *thread = new QThread();
+    TWorker *worker = safeWorker.release();
+    worker->setData(upright());
+    worker->moveToThread(thread);
+    worker->setRect(scaledRect(rect, _previewScale));
+    worker->setRegions(detectionRegions());
+    worker->setTicket(_lbfrJobs);
+    if (!_roiFile.isEmpty()) {
+        // the face is found on the preview, the points are fitted on the file
+        worker->setSource(_roiFile, viewTransform(), quarterTurns(), _previewScale);
+    }
+    worker->setDetectionScale(_detectionScale, .5 == _detectionScale ? uprightHalf() : QImage());
 
     connect(thread, &QThread::started, worker, &TWorker::process);
     connect(worker, &TWorker::finished, thread, &QThread::quit);
-    connect(worker, &TWorker::completeLBFRDetector, this, static_cast<void (MainWindow::*)(CPointFArray&)>(&MainWindow::sltLBFRDetector));
+    connect(worker, &TWorker::completeLBFRDetector, this, static_cast<void (MainWindow::*)(CPointFArray&, quint64)>(&MainWindow::sltLBFRDetector));
     connect(worker, &TWorker::finished, worker, &TWorker::deleteLater);
     connect(thread, &QThread::finished, thread, &QThread::deleteLater);
     connect(worker, &TWorker::noMemory, this, &MainWindow::sltNoMemory);
@@ -460,10 +713,35 @@ void MainWindow::fLBFRDetector()
 void MainWindow::nextFrame()
 {
     if (_safeStream) {
-        QImage newImage(static_cast<int>(_safeStream->getWidth()), static_cast<int>(_safeStream->getHeight()), QImage::Format::Format_RGB32);
-        if (_safeStream->getNextFrame(newImage)) {
-            _image0 = std::move(newImage);
+        // the tracker wants every frame upright, so let the decoder write it that way
+        const bool bUpright{_bTracking && Rotation::Rot0 != rotation_};
+        const QSize frameSize(static_cast<int>(_safeStream->getWidth()), static_cast<int>(_safeStream->getHeight()));
+        _safeStream->setRotation(bUpright ? quarterTurns() : 0);
+        QImage newImage(bUpright && Rotation::Rot180 != rotation_ ? frameSize.transposed() : frameSize, QImage::Format::Format_RGB32);
+        QImage newHalf;
+        if (.5 == _detectionScale) {
+            newHalf = QImage(newImage.size() / 2, QImage::Format::Format_RGB32);
+        }
+        if (_safeStream->getNextFrame(newImage, newHalf.isNull() ? nullptr : &newHalf)) {
+            _frameSize = frameSize;
+            if (bUpright) {
+                _image0 = QImage();
+                _half0 = QImage();
+                _image = std::move(newImage);
+                _half = std::move(newHalf);
+            }
+            else {
+                _image0 = std::move(newImage);
+                _half0 = std::move(newHalf);
+            }
+            _frameKey = DetectionCache::videoKey(_sourceName, _safeStream->getPts());
             this->Rotate();
+            if (_bTracking) {
+                fFaceTracker();
+            }
+            else {
+                showCached();
+            }
         }
     }
 }
@@ -475,62 +753,371 @@ void MainWindow::prevFrame()
     }
 }
 
-void MainWindow::sltNoMemory()
+void MainWindow::sltBatch()
 {
-    QMessageBox::warning(this, "Warning", "No enough memory");
+    if (!_safeStream || _batch) {
+        return;
+    }
+    bool bOk{};
+    const int frames = QInputDialog::getInt(this, tr("Batch Detection"), tr("Frames from the current one:"), 100, 1, std::max(1, static_cast<int>(_safeStream->getFramesCount())), 1, &bOk);
+    if (!bOk) {
+        return;
+    }
+    _batchScale = _detectionScale;
+    _batchEngine = landmarkEngineSelection();
+    auto safeJob = std::make_unique<BatchJob>(_sourceName, _safeStream->getPts(), frames, _batchScale);
+    QThread *thread = new QThread();
+    BatchJob *job = safeJob.release();
+    job->setRotation(quarterTurns());
+    job->moveToThread(thread);
+    _batch = job;
+
+    QProgressDialog *dlg = new QProgressDialog(tr("Detecting faces..."), tr("Cancel"), 0, frames, this);
+    dlg->setAttribute(Qt::WA_DeleteOnClose);
+    dlg->setWindowModality(Qt::NonModal);
+    dlg->show();
+
+    connect(thread, &QThread::started, job, &BatchJob::process);
+    connect(job, &BatchJob::finished, thread, &QThread::quit);
+    connect(job, &BatchJob::frameDone, this, &MainWindow::sltBatchFrame);
+    connect(job, &BatchJob::progress, dlg, &QProgressDialog::setValue);
+    connect(job, &BatchJob::finished, dlg, &QProgressDialog::close);
+    connect(job, &BatchJob::finished, this, &MainWindow::sltBatchFinished);
+    connect(dlg, &QProgressDialog::canceled, job, [job]{ job->cancel(); }, Qt::DirectConnection);
+    connect(job, &BatchJob::finished, job, &BatchJob::deleteLater);
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+
+    thread->start();
 }
 
-void MainWindow::AddPoint(const QPointF &p)
+void MainWindow::sltBatchFrame(const QString &frameKey, qint64 pts, const CRectArray &faces, const CPointFArray &points)
 {
-    auto item = std::make_unique<PointItem>(ptNum++);
-    item->setPos(p);
-    item->setFlag(QGraphicsItem::GraphicsItemFlag::ItemIsMovable, true);
-    item->setFlag(QGraphicsItem::GraphicsItemFlag::ItemIsSelectable, true);
-    _scene.addItem(item.release());
+    Q_UNUSED(pts);
+    _cache.insertFaces(DetectionCache::faceKey(frameKey, _batchScale), faces);
+    _cache.insertPoints(DetectionCache::batchPointsKey(frameKey, _batchScale, _batchEngine), points);
+    if (frameKey == _frameKey && _batchScale == _detectionScale && _batchEngine == landmarkEngineSelection()) {
+        showCached();
+    }
+}
+
+void MainWindow::sltBatchFinished(int frames, double seconds)
+{
+    statusBar()->showMessage(tr("Batch: %1 frames in %2 s, %3 fps").arg(frames).arg(seconds, 0, 'f', 1).arg(seconds > 0. ? frames / seconds : 0., 0, 'f', 1));
+}
+
+void MainWindow::sltExportVideo()
+{
+    if (!_safeStream || _export) {
+        return;
+    }
+    const QString outName = QFileDialog::getSaveFileName(this, tr("Export Video"), "", tr("AVI (*.avi)"));
+    if (outName.isNull()) {
+        return;
+    }
+    auto safeJob = std::make_unique<VideoExport>(_sourceName, outName, _detectionScale);
+    QThread *thread = new QThread();
+    VideoExport *job = safeJob.release();
+    job->setRotation(quarterTurns());
+    job->moveToThread(thread);
+    _export = job;
+
+    QProgressDialog *dlg = new QProgressDialog(tr("Exporting video..."), tr("Cancel"), 0, static_cast<int>(_safeStream->getFramesCount()), this);
+    dlg->setAttribute(Qt::WA_DeleteOnClose);
+    dlg->setWindowModality(Qt::NonModal);
+    dlg->show();
+
+    connect(thread, &QThread::started, job, &VideoExport::process);
+    connect(job, &VideoExport::finished, thread, &QThread::quit);
+    connect(job, &VideoExport::progress, dlg, &QProgressDialog::setValue);
+    connect(job, &VideoExport::finished, dlg, &QProgressDialog::close);
+    connect(job, &VideoExport::failed, dlg, &QProgressDialog::close);
+    connect(job, &VideoExport::failed, this, [this](const QString &reason){
+        QMessageBox::warning(this, QGuiApplication::applicationDisplayName(), tr("Export failed: %1").arg(reason));
+    });
+    connect(job, &VideoExport::finished, this, [this](int frames, double seconds){
+        statusBar()->showMessage(tr("Export: %1 frames in %2 s").arg(frames).arg(seconds, 0, 'f', 1));
+    });
+    connect(dlg, &QProgressDialog::canceled, job, [job]{ job->cancel(); }, Qt::DirectConnection);
+    connect(job, &VideoExport::finished, job, &VideoExport::deleteLater);
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+
+    thread->start();
+}
+
+void MainWindow::sltNoMemory()
+{
+    QMessageBox::warning(this, "Warning", "No enough memory");
 }
 
 void MainWindow::sltRotation0() {
     if (Rotation::Rot0 != rotation_) {
+        restoreSource();
         rotation_ = Rotation::Rot0;
-        Rotate();
+        Rotate(false);
     }
 }
 
 void MainWindow::sltRotation90() {
     if (Rotation::Rot90 != rotation_) {
+        restoreSource();
         rotation_ = Rotation::Rot90;
-        Rotate();
+        Rotate(false);
     }
 }
 
 void MainWindow::sltRotation270() {
     if (Rotation::Rot270 != rotation_) {
+        restoreSource();
         rotation_ = Rotation::Rot270;
-        Rotate();
+        Rotate(false);
     }
 }
 
-void MainWindow::Rotate() {
+QImage MainWindow::rotated(const QImage &img) const {
+    if (img.isNull()) {
+        return img;
+    }
     switch (rotation_) {
     case Rotation::Rot90:
-        _image = std::move(imgRotate<Rotate90>(_image0));
-        break;
+        return imgRotate<Rotate90>(img);
     case Rotation::Rot180:
-        _image = std::move(imgRotate<Rotate180>(_image0));
-        break;
+        return imgRotate<Rotate180>(img);
     case Rotation::Rot270:
-        _image = std::move(imgRotate<Rotate270>(_image0));
-        break;
+        return imgRotate<Rotate270>(img);
     case Rotation::Rot0:
     default:
-        _image = _image0;
-        break;
+        return img;
     };
-    QPixmap pixmap;
-    pixmap.convertFromImage(_image);
-    _scene.clear();
-    _scene.addPixmap(pixmap);
+}
+
+QPointF MainWindow::toView(const QPointF &p) const {
+    const QSize sz{_frameSize};
+    switch (rotation_) {
+    case Rotation::Rot90:
+        return Rotate90(sz.width(), sz.height()).getPoint(p);
+    case Rotation::Rot180:
+        return Rotate180(sz.width(), sz.height()).getPoint(p);
+    case Rotation::Rot270:
+        return Rotate270(sz.width(), sz.height()).getPoint(p);
+    case Rotation::Rot0:
+    default:
+        return p;
+    };
+}
+
+QPointF MainWindow::fromView(const QPointF &p) const {
+    const QSize sz{Rotation::Rot180 == rotation_ ? _frameSize : _frameSize.transposed()};
+    switch (rotation_) {
+    case Rotation::Rot90:
+        return Rotate270(sz.width(), sz.height()).getPoint(p);
+    case Rotation::Rot180:
+        return Rotate180(sz.width(), sz.height()).getPoint(p);
+    case Rotation::Rot270:
+        return Rotate90(sz.width(), sz.height()).getPoint(p);
+    case Rotation::Rot0:
+    default:
+        return p;
+    };
+}
+
+QRect MainWindow::toView(const QRect &r) const {
+    return QRect(toView(QPointF(r.topLeft())).toPoint(), toView(QPointF(r.bottomRight())).toPoint()).normalized();
+}
+
+QRect MainWindow::fromView(const QRect &r) const {
+    return QRect(fromView(QPointF(r.topLeft())).toPoint(), fromView(QPointF(r.bottomRight())).toPoint()).normalized();
+}
+
+void MainWindow::sltDetectionScale(QAction *act) {
+    _detectionScale = act->data().toDouble();
+}
+
+void MainWindow::sltLandmarkEngine(QAction *act) {
+    const QString name{act->data().toString()};
+    // the check stays on the engine in use until the new model is known to load
+    for (QAction *engineAct : act->actionGroup()->actions()) {
+        engineAct->setChecked(engineAct->data().toString() == landmarkEngineSelection());
+    }
+    _pendingEngine = name;
+    if (QStringLiteral("auto") == name) {
+        selectLandmarkEngine(name);
+        act->setChecked(true);
+        return;
+    }
+    statusBar()->showMessage(tr("Loading %1...").arg(act->text()));
+
+    // models are deserialized off the GUI thread like in warmUp
+    auto safeWorker = std::make_unique<TWorker>(TWorker::workerType::wtLoadEngine);
+    QThread *thread = new QThread();
+    TWorker *worker = safeWorker.release();
+    worker->setEngine(name);
+    worker->moveToThread(thread);
+
+    connect(thread, &QThread::started, worker, &TWorker::process);
+    connect(worker, &TWorker::finished, thread, &QThread::quit);
+    connect(worker, &TWorker::engineLoaded, this, [this, act, name](bool bValid){
+        // a later choice supersedes this one
+        if (name != _pendingEngine) {
+            return;
+        }
+        if (!bValid || !selectLandmarkEngine(name)) {
+            act->setEnabled(false);
+            statusBar()->showMessage(tr("%1: model not found").arg(act->text()));
+            return;
+        }
+        act->setChecked(true);
+        statusBar()->clearMessage();
+    });
+    connect(worker, &TWorker::finished, worker, &TWorker::deleteLater);
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+
+    thread->start(QThread::LowestPriority);
+}
+
+void MainWindow::sltRoiMode(bool bChecked) {
+    _bRoiMode = bChecked;
+}
+
+void MainWindow::sltTracking(bool bChecked) {
+    _bTracking = bChecked;
+    _framesSinceKey = 0;
+    _tracker->reset();
+}
+
+CRectArray MainWindow::detectionRegions() const {
+    CRectArray regions;
+    if (_bRoiMode) {
+        const auto items = _scene.items();
+        for (auto it{std::cbegin(items)}; it != std::cend(items); ++it) {
+            if (RectItem::Type == (*it)->type()) {
+                regions.push_back(qgraphicsitem_cast<RectItem*>(*it)->getRect());
+            }
+        }
+        if (regions.empty()) {
+            regions = _lastFaces;
+        }
+    }
+    // detectors see the preview of a region-decoded still
+    if (1. != _previewScale) {
+        std::transform(std::cbegin(regions), std::cend(regions), std::begin(regions), [this](const auto &e){ return scaledRect(e, _previewScale); });
+    }
+    return regions;
+}
+
+void MainWindow::Rotate(bool bNewFrame) {
+    // results of jobs still running belong to the previous frame
+    _faceJobs->revoke();
+    _lbfrJobs->revoke();
+    // the image item stays in the scene, only its contents and the annotations are swapped
+    clearAnnotations();
+    if (_image0.isNull()) {
+        // the decoder has already written the frame upright
+        showFrame(_image, QTransform());
+        return;
+    }
+    // the pixmap is turned by its item transform, upright pixels are made on demand
+    _image = QImage();
+    _half = QImage();
+    if (!bNewFrame) {
+        // a tiled item keeps its pyramid and loaded tiles, only the way it is shown changes
+        if (TiledImageItem *item = qgraphicsitem_cast<TiledImageItem*>(_imageItem)) {
+            item->setTransform(viewTransform());
+            return;
+        }
+    }
+    if (!_roiFile.isEmpty()) {
+        auto item = std::make_unique<TiledImageItem>(_roiFile, _frameSize, _image0);
+        item->setTransform(viewTransform());
+        setImageItem(std::move(item));
+        return;
+    }
+    if (static_cast<qint64>(_image0.width()) * _image0.height() > TiledImagePixels) {
+        auto item = std::make_unique<TiledImageItem>(_image0);
+        item->setTransform(viewTransform());
+        setImageItem(std::move(item));
+        return;
+    }
+    showFrame(_image0, viewTransform());
+}
+
+void MainWindow::showFrame(const QImage &img, const QTransform &t) {
+    FrameItem *item = qgraphicsitem_cast<FrameItem*>(_imageItem);
+    if (!item) {
+        auto safeItem = std::make_unique<FrameItem>();
+        item = safeItem.get();
+        setImageItem(std::move(safeItem));
+    }
+    item->setImage(img);
+    if (item->transform() != t) {
+        item->setTransform(t);
+    }
+}
+
+void MainWindow::setImageItem(std::unique_ptr<QGraphicsItem> item) {
+    delete _imageItem;
+    _imageItem = item.get();
+    _imageItem->setZValue(-1);
+    _scene.addItem(item.release());
+}
 
+void MainWindow::clearAnnotations() {
+    // children go with their parents
+    QList<QGraphicsItem*> annotations;
+    const auto items = _scene.items();
+    std::copy_if(std::cbegin(items), std::cend(items), std::back_inserter(annotations), [this](const auto &e){ return e != _imageItem && !e->parentItem(); });
+    qDeleteAll(annotations);
+    _rects.clear();
+}
+
+int MainWindow::quarterTurns() const {
+    switch (rotation_) {
+    case Rotation::Rot90:
+        return 1;
+    case Rotation::Rot180:
+        return 2;
+    case Rotation::Rot270:
+        return 3;
+    case Rotation::Rot0:
+    default:
+        return 0;
+    };
+}
+
+void MainWindow::restoreSource() {
+    // a frame decoded upright is turned back before the rotation changes
+    if (_image0.isNull() && !_image.isNull()) {
+        _image0 = rotateImage(_image, 4 - quarterTurns());
+        _half0 = rotateImage(_half, 4 - quarterTurns());
+    }
+}
+
+QTransform MainWindow::viewTransform() const {
+    const qreal w = _frameSize.width(), h = _frameSize.height();
+    switch (rotation_) {
+    case Rotation::Rot90:
+        return QTransform(0, 1, -1, 0, h, 0);
+    case Rotation::Rot180:
+        return QTransform(-1, 0, 0, -1, w, h);
+    case Rotation::Rot270:
+        return QTransform(0, -1, 1, 0, 0, w);
+    case Rotation::Rot0:
+    default:
+        return QTransform();
+    };
+}
+
+const QImage& MainWindow::upright() {
+    if (_image.isNull()) {
+        _image = rotated(_image0);
+    }
+    return _image;
+}
+
+const QImage& MainWindow::uprightHalf() {
+    if (_half.isNull()) {
+        _half = rotated(_half0);
+    }
+    return _half;
 }
 
 void MainWindow::sltAddRect() {
@@ -7,8 +7,10 @@
 #define MAINWINDOW_H
 
 #include "base.h"
+#include "detectioncache.h"
 
 #include <QMainWindow>
+#include <QPointer>
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QTabWidget>
@@ -38,6 +40,10 @@ private:
     RenderArea *renderArea;
 };
 
+class BatchJob;
+class VideoExport;
+class FaceTracker;
+class JobTicket;
 class VideoStream;
 
 class MainWindow : public QMainWindow
@@ -48,12 +54,14 @@ public:
     ~MainWindow() Q_DECL_OVERRIDE;
 
     void loadFile(const QString &);
+    void warmUp();
 protected:
     //void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
 
 private slots:
     void fFaceDetector();
     void fLBFRDetector();
+    void fFaceTracker();
 
     void sltNoMemory();
     void opnFile();
@@ -62,27 +70,64 @@ private slots:
     void expRect();
     void updateStatusBar(const QString &str);
     void sltFaceDetector(bool bChecked);
-    void sltFaceDetector(CRectArray &arr);
+    void sltFaceDetector(CRectArray &arr, quint64 job);
     void sltLBFRDetector(bool bChecked);
-    void sltLBFRDetector(CPointFArray &arr);
+    void sltLBFRDetector(CPointFArray &arr, quint64 job);
     void nextFrame();
     void prevFrame();
+    void sltBatch();
+    void sltBatchFrame(const QString &frameKey, qint64 pts, const CRectArray &faces, const CPointFArray &points);
+    void sltBatchFinished(int frames, double seconds);
+    void sltExportVideo();
     void sltRotation0();
     void sltRotation90();
     void sltRotation270();
+    void sltRoiMode(bool bChecked);
+    void sltTracking(bool bChecked);
+    void sltDetectionScale(QAction *act);
+    void sltLandmarkEngine(QAction *act);
     void sltAddRect();
     void sltAbout();
 
 private:
     enum class Rotation { Rot0, Rot90, Rot180, Rot270 };
-    void AddPoint(const QPointF &p);
     void AddRect(const QRect &r = QRect(0, 0, 60, 60));
-    void Rotate();
+    // bNewFrame is false when only the rotation changed and the image item can be kept
+    void Rotate(bool bNewFrame = true);
+    void showFrame(const QImage &img, const QTransform &t);
+    void setImageItem(std::unique_ptr<QGraphicsItem> item);
+    void clearAnnotations();
+    QImage rotated(const QImage &img) const;
+    int quarterTurns() const;
+    void restoreSource();
+    QTransform viewTransform() const;
+    const QImage& upright();
+    const QImage& uprightHalf();
+    QPointF toView(const QPointF &p) const;
+    QPointF fromView(const QPointF &p) const;
+    QRect toView(const QRect &r) const;
+    QRect fromView(const QRect &r) const;
+    void showFaces(const CRectArray &arr);
+    // arr holds the points of that many faces one after another, each face becomes an item of its own
+    void showPoints(const CPointFArray &arr, size_t faces = 1);
+    void showCached();
+    CRectArray detectionRegions() const;
 
     int ptNum = 0;
     QGraphicsScene _scene;
     QGraphicsView *_gview = nullptr;
+    // the frame item or a still's tiled item, kept across frames
+    QGraphicsItem *_imageItem = nullptr;
+    // _image0 owns the frame's pixels; the scene's FrameItem, the upright view of an
+    // unrotated frame and the detectors all share that buffer. _image and _half are
+    // real copies only when rotated, made when a detector asks; tracked video frames
+    // are decoded upright and leave _image0 and _half0 empty
     QImage _image0, _image;
+    QImage _half0, _half;
+    QSize _frameSize;
+    // a region-decoded still: _image0 holds its preview, _previewScale is preview pixels per image pixel
+    QString _roiFile;
+    double _previewScale = 1.;
     //RenderArea *renderArea = nullptr;
     QSlider *slider;
     QLabel *posLabel;
@@ -90,6 +135,21 @@ private:
     std::vector<QGraphicsEllipseItem*> _points;
     std::unique_ptr<VideoStream> _safeStream;
     Rotation rotation_{Rotation::Rot0};
+    bool _bRoiMode = false;
+    CRectArray _lastFaces;
+    bool _bTracking = false;
+    int _framesSinceKey = 0;
+    std::shared_ptr<FaceTracker> _tracker;
+    std::shared_ptr<JobTicket> _faceJobs, _lbfrJobs;
+    double _detectionScale = 1.;
+    DetectionCache _cache;
+    QString _sourceName, _frameKey, _faceKey, _lbfrKey;
+    QPointer<BatchJob> _batch;
+    QPointer<VideoExport> _export;
+    double _batchScale = 1.;
+    QString _batchEngine;
+    // landmark engine whose model is being loaded for selection
+    QString _pendingEngine;
 };
 
 #endif // MAINWINDOW_H
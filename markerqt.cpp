@@ -3,25 +3,113 @@
  * Copyright (c) 2017-2018 Kirill Lebedev
 **/
 
+#include "batchrunner.h"
+#include "engines.h"
 #include "mainwindow.h"
+#include "shapemodel.h"
 
 #include <QApplication>
 #include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QTimer>
+
+#include <cstring>
+#include <iostream>
+#include <memory>
 
 int main(int argc, char* argv[])
 {
-    QApplication app(argc, argv);
-    QGuiApplication::setApplicationDisplayName(MainWindow::tr("MarkerQt"));
+    // --batch and --benchmark run without widgets, so they work with no display attached
+    bool bBatch{false};
+    for (int i{1}; i < argc; ++i) {
+        bBatch = bBatch || 0 == std::strcmp(argv[i], "--batch") || 0 == std::strncmp(argv[i], "--batch=", 8)
+            || 0 == std::strcmp(argv[i], "--benchmark") || 0 == std::strncmp(argv[i], "--benchmark=", 12);
+    }
+    std::unique_ptr<QCoreApplication> app(bBatch ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
+    if (!bBatch)
+        QGuiApplication::setApplicationDisplayName(MainWindow::tr("MarkerQt"));
     QCommandLineParser commandLineParser;
     commandLineParser.addHelpOption();
     commandLineParser.addPositionalArgument(MainWindow::tr("[file]"), MainWindow::tr("Image file to open."));
+    QCommandLineOption convertOption(QStringLiteral("convert-model"), MainWindow::tr("Convert dlib shape predictor <dat> into the memory-mapped .bin format."), MainWindow::tr("dat"));
+    commandLineParser.addOption(convertOption);
+    QCommandLineOption quantizeOption(QStringLiteral("quantize"), MainWindow::tr("With --convert-model, store float16 leaf values in <base>.q16.bin."));
+    commandLineParser.addOption(quantizeOption);
+    QCommandLineOption noWarmUpOption(QStringLiteral("no-warmup"), MainWindow::tr("Load detection models on first use instead of at start."));
+    commandLineParser.addOption(noWarmUpOption);
+    QCommandLineOption batchOption(QStringLiteral("batch"), MainWindow::tr("Annotate every image in <input> directory or every frame of <input> video without a window."), MainWindow::tr("input"));
+    commandLineParser.addOption(batchOption);
+    QCommandLineOption outputOption(QStringLiteral("output"), MainWindow::tr("Directory for --batch results, defaults to markerqt next to the input."), MainWindow::tr("dir"));
+    commandLineParser.addOption(outputOption);
+    QCommandLineOption scaleOption(QStringLiteral("scale"), MainWindow::tr("Detection scale for --batch, 1 by default."), MainWindow::tr("s"), QStringLiteral("1"));
+    commandLineParser.addOption(scaleOption);
+    QCommandLineOption threadsOption(QStringLiteral("threads"), MainWindow::tr("Detection threads for --batch, all cores by default."), MainWindow::tr("N"), QStringLiteral("0"));
+    commandLineParser.addOption(threadsOption);
+    QCommandLineOption chipsOption(QStringLiteral("chips"), MainWindow::tr("Also write aligned <size> x <size> face chips with their landmarks for --batch."), MainWindow::tr("size"), QStringLiteral("0"));
+    commandLineParser.addOption(chipsOption);
+    QCommandLineOption paddingOption(QStringLiteral("padding"), MainWindow::tr("Border around --chips faces as a fraction of the face size, 0.2 by default."), MainWindow::tr("p"), QStringLiteral("0.2"));
+    commandLineParser.addOption(paddingOption);
+    QCommandLineOption shardsOption(QStringLiteral("shards"), MainWindow::tr("Split --batch input over N worker processes."), MainWindow::tr("N"), QStringLiteral("1"));
+    commandLineParser.addOption(shardsOption);
+    QCommandLineOption shardOption(QStringLiteral("shard"), MainWindow::tr("Annotate only part i of N of the --batch input."), MainWindow::tr("i/N"));
+    shardOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    commandLineParser.addOption(shardOption);
+    QCommandLineOption landmarksOption(QStringLiteral("landmarks"), MainWindow::tr("Landmark engine: auto, %1.").arg(landmarkEngineNames().join(QStringLiteral(", "))), MainWindow::tr("engine"), QStringLiteral("auto"));
+    commandLineParser.addOption(landmarksOption);
+    QCommandLineOption benchmarkOption(QStringLiteral("benchmark"), MainWindow::tr("Compare landmark engines on the images in <dir>."), MainWindow::tr("dir"));
+    commandLineParser.addOption(benchmarkOption);
     commandLineParser.process(QCoreApplication::arguments());
+    if (commandLineParser.isSet(convertOption)) {
+        const QFileInfo fi(commandLineParser.value(convertOption));
+        const bool bHalf{commandLineParser.isSet(quantizeOption)};
+        return ShapeModel::convert(fi.filePath(), fi.path() + QDir::separator() + fi.completeBaseName() + (bHalf ? QStringLiteral(".q16.bin") : QStringLiteral(".bin")), bHalf) ? 0 : 1;
+    }
+    if (!selectLandmarkEngine(commandLineParser.value(landmarksOption))) {
+        if (landmarkEngineNames().contains(commandLineParser.value(landmarksOption))) {
+            std::cout << "Landmark engine " << commandLineParser.value(landmarksOption).toStdString() << " has no model" << std::endl;
+            return 1;
+        }
+        commandLineParser.showHelp(1);
+    }
+    if (commandLineParser.isSet(benchmarkOption)) {
+        return runBenchmark(commandLineParser.value(benchmarkOption));
+    }
+    if (bBatch) {
+        BatchOptions opt;
+        opt.outDir = commandLineParser.value(outputOption);
+        bool bScale{false}, bThreads{false}, bShards{false}, bChips{false}, bPadding{false};
+        opt.scale = commandLineParser.value(scaleOption).toDouble(&bScale);
+        opt.threads = commandLineParser.value(threadsOption).toInt(&bThreads);
+        opt.chipSize = commandLineParser.value(chipsOption).toInt(&bChips);
+        opt.chipPadding = commandLineParser.value(paddingOption).toDouble(&bPadding);
+        const int shards{commandLineParser.value(shardsOption).toInt(&bShards)};
+        if (!bScale || opt.scale <= 0. || opt.scale > 1. || !bThreads || opt.threads < 0 || !bShards || shards < 1
+            || !bChips || opt.chipSize < 0 || !bPadding || opt.chipPadding < 0.) {
+            commandLineParser.showHelp(1);
+        }
+        if (commandLineParser.isSet(shardOption)) {
+            const QStringList part{commandLineParser.value(shardOption).split('/')};
+            bool bIndex{false}, bCount{false};
+            const int index{part.front().toInt(&bIndex)}, count{part.back().toInt(&bCount)};
+            if (2 != part.size() || !bIndex || !bCount || index < 0 || index >= count) {
+                commandLineParser.showHelp(1);
+            }
+            return runBatch(commandLineParser.value(batchOption), opt, index, count);
+        }
+        if (shards > 1) {
+            return runShards(commandLineParser.value(batchOption), opt, shards);
+        }
+        return runBatch(commandLineParser.value(batchOption), opt);
+    }
     MainWindow w;
     if (!commandLineParser.positionalArguments().isEmpty())
         w.loadFile(commandLineParser.positionalArguments().front());
     w.showMaximized();
+    if (!commandLineParser.isSet(noWarmUpOption))
+        QTimer::singleShot(0, &w, &MainWindow::warmUp);
 #ifdef Q_OS_SYMBIAN
-    app.setNavigationMode(Qt::NavigationModeCursorAuto);
+    static_cast<QApplication*>(app.get())->setNavigationMode(Qt::NavigationModeCursorAuto);
 #endif
-    return app.exec();
+    return app->exec();
 }
@@ -0,0 +1,23 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "overlay.h"
+#include <QPainter>
+#include <algorithm>
+
+void drawOverlay(QPainter &painter, const mapperPt &mapper, const CRectArray &frects, const CPointFArray &pts)
+{
+    if (!frects.empty()) {
+        QPen oldPen = painter.pen();
+        painter.setPen(QPen(Qt::red, 2));
+        std::for_each(frects.cbegin(), frects.cend(), [&mapper, &painter](const auto &e){ painter.drawRect(mapper.mapTo(e)); });
+        painter.setPen(oldPen);
+    }
+    for (size_t i(0); i < pts.size(); ++i) {
+        const auto ptDraw = mapper.mapTo(QPointF(pts[i].x(), pts[i].y()));
+        painter.drawLine(ptDraw - QPoint(2, 2), ptDraw + QPoint(1, 1));
+        painter.drawLine(ptDraw + QPoint(-2, 2), ptDraw + QPoint(1, -1));
+    }
+}
@@ -0,0 +1,36 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "base.h"
+#include <QPoint>
+#include <QPointF>
+#include <QRectF>
+#include <cmath>
+
+class QPainter;
+
+// image coordinates to target coordinates, centerFrom lands on centerTo
+class mapperPt {
+public:
+    constexpr mapperPt(const QPoint &centerTo, const QPointF &centerFrom, const QPointF &scale) : _centerTo(centerTo), _centerFrom(centerFrom), _scale(scale)
+    { }
+    QPoint mapTo(const QPointF &v) const {
+        return QPoint(std::round(_centerTo.x() + (v.x() - _centerFrom.x()) / _scale.x()), std::round(_centerTo.y() + (v.y() - _centerFrom.y()) / _scale.y()));
+    }
+    QRectF mapTo(const QRect &v) const {
+        return QRectF(mapTo(v.topLeft()), mapTo(v.bottomRight()));
+    }
+private:
+    QPoint _centerTo;
+    QPointF _centerFrom, _scale;
+};
+
+// face rectangles in red, landmarks as small crosses in the painter's current pen
+void drawOverlay(QPainter &painter, const mapperPt &mapper, const CRectArray &frects, const CPointFArray &pts);
+
+#endif // OVERLAY_H
@@ -8,9 +8,12 @@
 #include "mainwindow.h"
 #include "worker.h"
 
+#include <cmath>
+#include <numeric>
 #include <random>
 #include <time.h>
 #include <QDir>
+#include <QFontMetricsF>
 #include <QFile>
 #include <QGestureEvent>
 #include <QGraphicsSceneEvent>
@@ -20,8 +23,10 @@
 #include <QMessageBox>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QPixmapCache>
 #include <QScrollBar>
 #include <QShortcut>
+#include <QStyleOptionGraphicsItem>
 #include <QTabBar>
 
 constexpr double DefaultScale{1.0};
@@ -32,56 +37,244 @@ extern const int ScrollStep{20};
 
 Q_LOGGING_CATEGORY(lcExample, "QtMarker")
 
-QRectF PointItem::boundingRect() const {
-    qreal dx(5);
-    if (_m11 < 1.) {
-        dx /= _m11;
+namespace
+{
+
+// labels appear once a point is this much magnified
+constexpr qreal LabelZoom{4.};
+// marker half sizes in device pixels
+constexpr qreal MarkerHit{5.}, MarkerCross{3.};
+
+const QFont& labelFont() {
+    static const QFont font("Tahoma", 10, QFont::Bold);
+    return font;
+}
+
+const QFontMetricsF& labelMetrics() {
+    static const QFontMetricsF fm(labelFont());
+    return fm;
+}
+
+// label of a number drawn with its baseline at the origin, with room for the outline;
+// the text is measured, digits of a proportional font differ in width
+QRectF labelRect(int num) {
+    const QFontMetricsF &fm = labelMetrics();
+    const QString text{QString::number(num)};
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    const qreal width{fm.horizontalAdvance(text)};
+#else
+    const qreal width{fm.width(text)};
+#endif
+    return QRectF(-2, -fm.ascent() - 2, width + 4, fm.height() + 4);
+}
+
+// outlined labels are shaped and rasterized once per number and pixel ratio
+QPixmap labelPixmap(int num, qreal dpr) {
+    const QString key{QStringLiteral("marker_label_%1_%2").arg(num).arg(dpr)};
+    QPixmap pm;
+    if (!QPixmapCache::find(key, &pm)) {
+        const QRectF r{labelRect(num)};
+        pm = QPixmap(static_cast<int>(std::ceil(r.width() * dpr)), static_cast<int>(std::ceil(r.height() * dpr)));
+        pm.setDevicePixelRatio(dpr);
+        pm.fill(Qt::transparent);
+        QPainter painter(&pm);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.translate(-r.topLeft());
+        QPainterPath path;
+        path.addText(QPointF(), labelFont(), QString::number(num));
+        painter.setPen(QPen(Qt::black, 4));
+        painter.drawPath(path);
+        painter.fillPath(path, QBrush(Qt::white));
+        painter.end();
+        QPixmapCache::insert(key, pm);
     }
-    return QRectF(-dx, -dx, 2 * dx, 2 * dx);
+    return pm;
+}
+
+void drawLabel(QPainter *painter, const QPointF &pos, int num) {
+    // the pixmap carries the measured width, only the baseline offset is needed here
+    painter->drawPixmap(pos + QPointF(-2, -labelMetrics().ascent() - 2), labelPixmap(num, painter->device()->devicePixelRatioF()));
+}
+
+} // namespace unnamed
+
+PointItem::PointItem(int n) : num_(n), _bounds(QRectF(-MarkerHit, -MarkerHit, 2 * MarkerHit, 2 * MarkerHit).united(labelRect(n))) {
+    // item coordinates are device pixels, the marker keeps its size and geometry at any zoom
+    this->setFlag(QGraphicsItem::ItemIgnoresTransformations, true);
+}
+
+void PointItem::setViewScale(qreal scale) {
+    if (_viewScale != scale) {
+        const bool bLabel{_viewScale > LabelZoom};
+        _viewScale = scale;
+        if (bLabel != (_viewScale > LabelZoom)) {
+            update();
+        }
+    }
+}
+
+QRectF PointItem::boundingRect() const {
+    return _bounds;
+}
+
+QPainterPath PointItem::shape() const {
+    QPainterPath path;
+    path.addRect(QRectF(-MarkerHit, -MarkerHit, 2 * MarkerHit, 2 * MarkerHit));
+    return path;
 }
 
 void PointItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
     Q_UNUSED(option);
     Q_UNUSED(widget);
-    QTransform t = painter->transform();
-    _m11 = t.m11();
-    qreal dx(3);
-    if (_m11 < 1.) {
-        dx /= _m11;
-    }
+    constexpr qreal dx{MarkerCross};
     if (this->isSelected()) {
-        qreal width(2.5);
-        if (_m11 < 1.) {
-            width /= _m11;
-        }
-        painter->setPen(QPen(Qt::black, width));
+        painter->setPen(QPen(Qt::black, 2.5));
         painter->drawLine(QPointF(-dx, -dx), QPointF(dx, dx));
         painter->drawLine(QPointF(-dx, dx), QPointF(dx, -dx));
     }
-    qreal width(2);
-    if (_m11 < 1.) {
-        width /= _m11;
-    }
-    painter->setPen(QPen(Qt::red, width));
+    painter->setPen(QPen(Qt::red, 2));
     painter->drawLine(QPointF(-dx, -dx), QPointF(dx, dx));
     painter->drawLine(QPointF(-dx, dx), QPointF(dx, -dx));
-    if (_m11 > 4.) {
+    if (_viewScale > LabelZoom) {
+        drawLabel(painter, QPointF(), num_);
+    }
+}
+
+LandmarkSetItem::LandmarkSetItem(const CPointFArray &pts, int firstNum) : _pts(pts), _nums(pts.size()) {
+    std::iota(_nums.begin(), _nums.end(), firstNum);
+    this->setFlag(QGraphicsItem::GraphicsItemFlag::ItemIsSelectable, true);
+    updateBounds();
+}
+
+void LandmarkSetItem::setViewScale(qreal scale) {
+    if (_viewScale != scale) {
+        // markers and labels keep their screen size, so their scene extent changes
+        prepareGeometryChange();
+        _viewScale = scale;
+    }
+}
+
+qreal LandmarkSetItem::markerRadius() const {
+    return MarkerHit / _viewScale;
+}
+
+void LandmarkSetItem::updateBounds() {
+    prepareGeometryChange();
+    if (_pts.empty()) {
+        _bounds = _label = QRectF();
+        return;
+    }
+    // widest label of the set, measured here rather than in boundingRect
+    _label = QRectF();
+    for (const int num : _nums) {
+        _label = _label.united(labelRect(num));
+    }
+    const auto xs = std::minmax_element(_pts.cbegin(), _pts.cend(), [](const auto &a, const auto &b){ return a.x() < b.x(); });
+    const auto ys = std::minmax_element(_pts.cbegin(), _pts.cend(), [](const auto &a, const auto &b){ return a.y() < b.y(); });
+    _bounds = QRectF(QPointF(xs.first->x(), ys.first->y()), QPointF(xs.second->x(), ys.second->y()));
+}
+
+int LandmarkSetItem::hitTest(const QPointF &p) const {
+    const qreal r{markerRadius()};
+    int best{-1};
+    qreal bestDist{r * r};
+    for (size_t i{}; i < _pts.size(); ++i) {
+        const QPointF d{_pts[i] - p};
+        const qreal dist{QPointF::dotProduct(d, d)};
+        if (dist <= bestDist) {
+            best = static_cast<int>(i);
+            bestDist = dist;
+        }
+    }
+    return best;
+}
+
+void LandmarkSetItem::removePoint(int idx) {
+    if (idx >= 0 && static_cast<size_t>(idx) < _pts.size()) {
+        _pts.erase(_pts.begin() + idx);
+        _nums.erase(_nums.begin() + idx);
+        _selected = _drag = -1;
+        updateBounds();
+    }
+}
+
+QRectF LandmarkSetItem::boundingRect() const {
+    const qreal dx{markerRadius()};
+    QRectF r{_bounds.adjusted(-dx, -dx, dx, dx)};
+    if (_viewScale > LabelZoom && !_pts.empty()) {
+        r = r.united(_bounds.adjusted(_label.left() / _viewScale, _label.top() / _viewScale, _label.right() / _viewScale, _label.bottom() / _viewScale));
+    }
+    return r;
+}
+
+QPainterPath LandmarkSetItem::shape() const {
+    const qreal dx{markerRadius()};
+    QPainterPath path;
+    for (const auto &e : _pts) {
+        path.addRect(QRectF(e.x() - dx, e.y() - dx, 2 * dx, 2 * dx));
+    }
+    return path;
+}
+
+void LandmarkSetItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(option);
+    Q_UNUSED(widget);
+    const QTransform t = painter->transform();
+    const qreal scale{1. / _viewScale};
+    const qreal dx{MarkerCross * scale};
+
+    QVector<QLineF> lines;
+    lines.reserve(2 * static_cast<int>(_pts.size()));
+    for (const auto &e : _pts) {
+        lines.append(QLineF(e.x() - dx, e.y() - dx, e.x() + dx, e.y() + dx));
+        lines.append(QLineF(e.x() - dx, e.y() + dx, e.x() + dx, e.y() - dx));
+    }
+    if (this->isSelected()) {
+        painter->setPen(QPen(Qt::black, 2.5 * scale));
+        painter->drawLines(lines);
+    }
+    else if (_selected >= 0) {
+        painter->setPen(QPen(Qt::black, 2.5 * scale));
+        painter->drawLines(lines.constData() + 2 * _selected, 2);
+    }
+    painter->setPen(QPen(Qt::red, 2 * scale));
+    painter->drawLines(lines);
+
+    if (_viewScale > LabelZoom) {
         painter->save();
-        painter->setTransform(QTransform(1, t.m12(), t.m12(), t.m21(), 1, t.m23(), t.m31(), t.m32(), t.m33()));
-        //auto font = painter->font();
-        //font.setPixelSize();
-        QPainterPath path;
-        path.addText(0, 0, QFont("Tahoma", 10, QFont::Bold), QString("%1").arg(num_));
-        //painter->setFont(QFont("Tahoma", 10, QFont::Bold));
-        painter->setPen(QPen(Qt::black, 4));
-        //painter->drawText(0, 0, QString("%1").arg(num_));
-        painter->drawPath(path);
-        painter->fillPath(path, QBrush(Qt::white));
-        //painter->drawText(QRectF(0., 0., 2. * m11, 1. * m11), QString("%1").arg(num_));
+        painter->setTransform(QTransform());
+        for (size_t i{}; i < _pts.size(); ++i) {
+            drawLabel(painter, t.map(_pts[i]), _nums[i]);
+        }
         painter->restore();
     }
 }
 
+void LandmarkSetItem::mousePressEvent(QGraphicsSceneMouseEvent *event) {
+    const int idx{Qt::LeftButton == event->button() ? hitTest(event->pos()) : -1};
+    if (idx < 0) {
+        // let the items below have it
+        event->ignore();
+        return;
+    }
+    _selected = _drag = idx;
+    update();
+    event->accept();
+}
+
+void LandmarkSetItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event) {
+    if (_drag >= 0) {
+        _pts[_drag] = event->pos();
+        updateBounds();
+        update();
+    }
+}
+
+void LandmarkSetItem::mouseReleaseEvent(QGraphicsSceneMouseEvent *event) {
+    Q_UNUSED(event);
+    _drag = -1;
+}
+
 RectItem::RectItem(const QRect &r) : _outterborderColor(Qt::red), _outterborderPen(_outterborderColor, 2), _outterborderBrush(QColor(150, 150, 150, 125), Qt::NoBrush), _width(r.width()), _height(r.height()) {
     this->setPos(r.topLeft());
     this->setAcceptHoverEvents(true);
@@ -250,6 +443,29 @@ void RectItem::setCornerPositions() {
     _corners[3]->setPos(-_drawingOrigenX, _height + _YcornerGrabBuffer - _corners[3]->boundingRect().height());
 }
 
+FrameItem::FrameItem() {
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+}
+
+void FrameItem::setImage(const QImage &img) {
+    // same sized frames leave the scene index alone
+    if (img.size() != _image.size()) {
+        prepareGeometryChange();
+    }
+    _image = img;
+    update();
+}
+
+QRectF FrameItem::boundingRect() const {
+    return QRectF(QPointF(), _image.size());
+}
+
+void FrameItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+    const QRectF exposed{option->exposedRect.intersected(boundingRect())};
+    painter->drawImage(exposed, _image, exposed);
+}
+
 /*bool MyVideoSurface::present(const QVideoFrame &frame)
 {
     Q_UNUSED(frame);
@@ -323,6 +539,16 @@ void RenderArea::wheelEvent(QWheelEvent *event) {
     h11 = h22 = std::pow(_scaleStep, _scaleFactor);
     setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
     setTransform(QTransform(h11, h12, h21, h22, 0, 0));
+    // geometry follows the zoom here, never from inside paint
+    const auto items = this->items();
+    for (auto it = items.cbegin(); it != items.cend(); ++it) {
+        if (auto p = qgraphicsitem_cast<PointItem*>(*it)) {
+            p->setViewScale(h11);
+        }
+        else if (auto p = qgraphicsitem_cast<LandmarkSetItem*>(*it)) {
+            p->setViewScale(h11);
+        }
+    }
 }
 
 void RenderArea::mousePressEvent(QMouseEvent *event) {
@@ -335,6 +561,7 @@ void RenderArea::mousePressEvent(QMouseEvent *event) {
     else if (Qt::LeftButton == event->button() && Qt::ControlModifier == event->modifiers()) {
         auto n = this->getNextNum();
         auto *item = new PointItem(n);
+        item->setViewScale(h11);
         item->setPos(mapToScene(event->pos()));
         item->setFlag(QGraphicsItem::GraphicsItemFlag::ItemIsMovable, true);
         item->setFlag(QGraphicsItem::GraphicsItemFlag::ItemIsSelectable, true);
@@ -345,6 +572,9 @@ void RenderArea::mousePressEvent(QMouseEvent *event) {
         if (auto *item = dynamic_cast<PointItem*>(this->itemAt(event->pos()))) {
             this->scene()->removeItem(item);
         }
+        else if (auto *item = dynamic_cast<LandmarkSetItem*>(this->itemAt(event->pos()))) {
+            item->removePoint(item->hitTest(item->mapFromScene(mapToScene(event->pos()))));
+        }
         else if (auto *item = dynamic_cast<QGraphicsRectItem*>(this->itemAt(event->pos()))) {
             this->scene()->removeItem(item);
         }
@@ -381,9 +611,18 @@ void RenderArea::mouseMoveEvent(QMouseEvent *event) {
 int RenderArea::getNextNum() const {
     auto items = this->items();
     std::vector<bool> v(items.size());
+    const auto mark = [&v](int n) {
+        if (n >= static_cast<int>(v.size())) {
+            v.resize(n + 1);
+        }
+        v[n] = true;
+    };
     for (auto it = items.cbegin(); it != items.cend(); ++it) {
         if (auto p = dynamic_cast<PointItem*>(*it)) {
-            v[p->getNum()] = true;
+            mark(p->getNum());
+        }
+        else if (auto p = dynamic_cast<LandmarkSetItem*>(*it)) {
+            std::for_each(p->getNums().cbegin(), p->getNums().cend(), mark);
         }
     }
     int i = 0;
@@ -39,13 +39,15 @@ class PointItem : public QGraphicsItem
 public:
     enum { Type = UserType + 4 };
 
-    explicit PointItem(int n) : num_(n)
-    { }
+    explicit PointItem(int n);
     int getNum() const {
         return num_;
     }
+    // view zoom, only decides whether the number is shown
+    void setViewScale(qreal scale);
 
     QRectF boundingRect() const Q_DECL_OVERRIDE;
+    QPainterPath shape() const Q_DECL_OVERRIDE;
     void paint(QPainter *paint, const QStyleOptionGraphicsItem *option, QWidget *widget) Q_DECL_OVERRIDE;
     int type() const Q_DECL_OVERRIDE {
         return Type;
@@ -53,7 +55,54 @@ public:
 
 private:
     int num_;
-    qreal _m11 = 1.;
+    QRectF _bounds;
+    qreal _viewScale = 1.;
+};
+
+// All landmarks of one face in a single item: positions and numbers live in
+// contiguous arrays and every marker is drawn in one batched call. Points are
+// picked, selected and dragged through the item's own hit testing.
+class LandmarkSetItem : public QGraphicsItem
+{
+public:
+    enum { Type = UserType + 8 };
+
+    LandmarkSetItem(const CPointFArray &pts, int firstNum);
+    const CPointFArray& getPoints() const {
+        return _pts;
+    }
+    const std::vector<int>& getNums() const {
+        return _nums;
+    }
+    // index of the point within the marker radius of p, -1 if none
+    int hitTest(const QPointF &p) const;
+    void removePoint(int idx);
+    // view zoom, markers keep a constant screen size
+    void setViewScale(qreal scale);
+
+    QRectF boundingRect() const Q_DECL_OVERRIDE;
+    QPainterPath shape() const Q_DECL_OVERRIDE;
+    void paint(QPainter *paint, const QStyleOptionGraphicsItem *option, QWidget *widget) Q_DECL_OVERRIDE;
+    int type() const Q_DECL_OVERRIDE {
+        return Type;
+    }
+
+protected:
+    void mousePressEvent(QGraphicsSceneMouseEvent *event) Q_DECL_OVERRIDE;
+    void mouseMoveEvent(QGraphicsSceneMouseEvent *event) Q_DECL_OVERRIDE;
+    void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    qreal markerRadius() const;
+    void updateBounds();
+
+    CPointFArray _pts;
+    std::vector<int> _nums;
+    int _selected = -1, _drag = -1;
+    QRectF _bounds;
+    // extent of the widest label around its point, in device pixels
+    QRectF _label;
+    qreal _viewScale = 1.;
 };
 
 class RectItem : public QGraphicsItem
@@ -92,6 +141,26 @@ private:
     std::array<std::unique_ptr<CornerGrabber>, 4> _corners;
 };
 
+// Paints a frame straight from its QImage. The buffer stays shared with the
+// window and the detectors instead of being converted into a QPixmap copy.
+class FrameItem : public QGraphicsItem
+{
+public:
+    enum { Type = UserType + 7 };
+
+    FrameItem();
+    void setImage(const QImage &img);
+
+    QRectF boundingRect() const Q_DECL_OVERRIDE;
+    void paint(QPainter *paint, const QStyleOptionGraphicsItem *option, QWidget *widget) Q_DECL_OVERRIDE;
+    int type() const Q_DECL_OVERRIDE {
+        return Type;
+    }
+
+private:
+    QImage _image;
+};
+
 class RenderArea : public QGraphicsView
 {
     Q_OBJECT
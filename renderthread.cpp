@@ -4,6 +4,7 @@
 **/
 
 #include "renderthread.h"
+#include "overlay.h"
 #include <QtGui>
 #include <array>
 #include <cmath>
@@ -23,21 +24,6 @@ private:
     qreal _centerFrom, _scale;
 };
 
-class mapperPt {
-public:
-    constexpr mapperPt(const QPoint &centerTo, const QPointF &centerFrom, const QPointF &scale) : _centerTo(centerTo), _centerFrom(centerFrom), _scale(scale)
-    { }
-    QPoint mapTo(const QPointF &v) const {
-        return QPoint(std::round(_centerTo.x() + (v.x() - _centerFrom.x()) / _scale.x()), std::round(_centerTo.y() + (v.y() - _centerFrom.y()) / _scale.y()));
-    }
-    QRectF mapTo(const QRect &v) const {
-        return QRectF(mapTo(v.topLeft()), mapTo(v.bottomRight()));
-    }
-private:
-    QPoint _centerTo;
-    QPointF _centerFrom, _scale;
-};
-
 RenderThread::RenderThread(QObject *parent)
     : QThread(parent), restart(ATOMIC_VAR_INIT(false)), abort(false)
 {
@@ -108,31 +94,7 @@ void RenderThread::run()
             painter.drawImage(rectDst, image, rectSrc);
         }
 
-        if (!frects.empty()) {
-            const mapperPt mapper(QPoint(halfWidth, halfHeight), scrCenter, QPointF(scaleFactor, scaleFactor));
-            QPen oldPen = painter.pen();
-            painter.setPen(QPen(Qt::red, 2));
-            std::for_each(frects.cbegin(), frects.cend(), [&mapper, &painter](const auto &e){ painter.drawRect(mapper.mapTo(e)); });
-            /*const size_t count(frects.size());
-            std::array<QPointF, 5> points;
-            for (size_t i(0); i < count; ++i) {
-                points[0] = mapper.mapTo(frects[i].topLeft()); // QPoint(halfWidth + (-centerX + frects[i].left()) / scaleFactor, halfHeight + (-centerY + frects[i].top()) / scaleFactor);
-                points[1] = mapper.mapTo(frects[i].topRight()); // QPoint(halfWidth + (-centerX + frects[i].right()) / scaleFactor, halfHeight + (-centerY + frects[i].top()) / scaleFactor);
-                points[2] = mapper.mapTo(frects[i].bottomRight()); // QPoint(halfWidth + (-centerX + frects[i].right()) / scaleFactor, halfHeight + (-centerY + frects[i].bottom()) / scaleFactor);
-                points[3] = mapper.mapTo(frects[i].bottomLeft()); // QPoint(halfWidth + (-centerX + frects[i].left()) / scaleFactor, halfHeight + (-centerY + frects[i].bottom()) / scaleFactor);
-                points[4] = points[0];
-                painter.drawPolyline(points.data(), points.size());
-            }*/
-            painter.setPen(oldPen);
-        }
-        if (!pts.empty()) {
-            const mapperPt mapper(QPoint(halfWidth, halfHeight), scrCenter, QPointF(scaleFactor, scaleFactor));
-            for (size_t i(0); i < pts.size(); ++i) {
-                const auto ptDraw = mapper.mapTo(QPointF(pts[i].x(), pts[i].y()));
-                painter.drawLine(ptDraw - QPoint(2, 2), ptDraw + QPoint(1, 1));
-                painter.drawLine(ptDraw + QPoint(-2, 2), ptDraw + QPoint(1, -1));
-            }
-        }
+        drawOverlay(painter, mapperPt(QPoint(halfWidth, halfHeight), scrCenter, QPointF(scaleFactor, scaleFactor)), frects, pts);
 
         if (!restart.load(std::memory_order_relaxed)) {
             emit renderedImage(imageRes, scrCenter, scaleFactor);
@@ -0,0 +1,351 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "shapemodel.h"
+#include <dlib/image_processing/shape_predictor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SHAPEMODEL_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+constexpr char Magic[8] = {'M', 'Q', 'S', 'H', 'A', 'P', 'E', '\0'};
+// version 2 stores 16-bit thresholds and float16 leaf values
+constexpr uint32_t Version{1};
+constexpr uint32_t VersionHalf{2};
+constexpr uint64_t SectionAlign{64};
+
+constexpr uint64_t align(uint64_t v) {
+    return (v + SectionAlign - 1) & ~(SectionAlign - 1);
+}
+
+// section offsets are fully defined by the model dimensions
+void layout(ShapeModel::Header &hdr) {
+    const uint64_t cascadeFeatures{static_cast<uint64_t>(hdr.numCascades) * hdr.numFeatures};
+    const uint64_t trees{static_cast<uint64_t>(hdr.numCascades) * hdr.numTrees};
+    hdr.offInitialShape = align(sizeof(ShapeModel::Header));
+    hdr.offAnchors = align(hdr.offInitialShape + 2 * hdr.numParts * sizeof(float));
+    hdr.offDeltas = align(hdr.offAnchors + cascadeFeatures * sizeof(uint32_t));
+    hdr.offSplits = align(hdr.offDeltas + 2 * cascadeFeatures * sizeof(float));
+    const bool bHalf{VersionHalf == hdr.version};
+    hdr.offLeaves = align(hdr.offSplits + trees * hdr.numSplits * (bHalf ? sizeof(ShapeModel::HalfSplit) : sizeof(ShapeModel::Split)));
+    hdr.fileSize = hdr.offLeaves + trees * (hdr.numSplits + 1) * 2 * hdr.numParts * (bHalf ? sizeof(uint16_t) : sizeof(float));
+}
+
+// IEEE 754 binary16, rounded to nearest even
+uint16_t toHalf(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    const uint16_t sign{static_cast<uint16_t>((x >> 16) & 0x8000)};
+    x &= 0x7fffffff;
+    if (x >= 0x47800000) {
+        return sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00);
+    }
+    if (x < 0x38800000) {
+        // subnormal, in units of 2^-24
+        return sign | static_cast<uint16_t>(std::nearbyint(std::fabs(f) * 16777216.f));
+    }
+    x -= 112u << 23;
+    x += 0xfff + ((x >> 13) & 1);
+    return sign | static_cast<uint16_t>(x >> 13);
+}
+
+inline float fromHalf(uint16_t h) {
+    const uint32_t sign{(h & 0x8000u) << 16}, exp{(h >> 10) & 0x1fu}, man{h & 0x3ffu};
+    if (0 == exp) {
+        const float f{man * 5.9604645e-8f};
+        return sign ? -f : f;
+    }
+    const uint32_t x{sign | (31 == exp ? 0x7f800000 | (man << 13) : ((exp + 112) << 23) | (man << 13))};
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+// similarity transform [a -b; b a] best mapping shape 'from' onto shape 'to'
+void similarity(const float *from, const float *to, const uint32_t n, float &a, float &b) {
+    double mfx{}, mfy{}, mtx{}, mty{};
+    for (uint32_t i{}; i < n; ++i) {
+        mfx += from[2 * i];
+        mfy += from[2 * i + 1];
+        mtx += to[2 * i];
+        mty += to[2 * i + 1];
+    }
+    mfx /= n;
+    mfy /= n;
+    mtx /= n;
+    mty /= n;
+    double sigma{}, sa{}, sb{};
+    for (uint32_t i{}; i < n; ++i) {
+        const double fx{from[2 * i] - mfx}, fy{from[2 * i + 1] - mfy};
+        const double tx{to[2 * i] - mtx}, ty{to[2 * i + 1] - mty};
+        sigma += fx * fx + fy * fy;
+        sa += fx * tx + fy * ty;
+        sb += fx * ty - fy * tx;
+    }
+    a = static_cast<float>(sa / sigma);
+    b = static_cast<float>(sb / sigma);
+}
+
+// feature positions in face coordinates, [a -b; b a] * delta + anchor for every feature;
+// the vector path keeps the scalar operation order, so both give identical results
+void featurePositions(const float *shape, const uint32_t *anchors, const float *deltas, const uint32_t n, const float a, const float b, float *xs, float *ys) {
+    uint32_t i{};
+#ifdef SHAPEMODEL_SSE2
+    const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 lo = _mm_loadu_ps(deltas + 2 * i), hi = _mm_loadu_ps(deltas + 2 * i + 4);
+        const __m128 dx = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), dy = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+        const float *p0 = shape + 2 * anchors[i], *p1 = shape + 2 * anchors[i + 1], *p2 = shape + 2 * anchors[i + 2], *p3 = shape + 2 * anchors[i + 3];
+        const __m128 ax = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]), ay = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+        _mm_storeu_ps(xs + i, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(va, dx), _mm_mul_ps(vb, dy)), ax));
+        _mm_storeu_ps(ys + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(vb, dx), _mm_mul_ps(va, dy)), ay));
+    }
+#endif
+    for (; i < n; ++i) {
+        const float dx{deltas[2 * i]}, dy{deltas[2 * i + 1]};
+        const float *anchor = shape + 2 * anchors[i];
+        xs[i] = a * dx - b * dy + anchor[0];
+        ys[i] = b * dx + a * dy + anchor[1];
+    }
+}
+
+// shape += leaf, the bulk of the arithmetic: numTrees leaves of 2 * numParts values per cascade
+inline void addLeaf(float *shape, const float *leaf, const size_t n) {
+    size_t k{};
+#ifdef SHAPEMODEL_SSE2
+    for (; k + 4 <= n; k += 4) {
+        _mm_storeu_ps(shape + k, _mm_add_ps(_mm_loadu_ps(shape + k), _mm_loadu_ps(leaf + k)));
+    }
+#endif
+    for (; k < n; ++k) {
+        shape[k] += leaf[k];
+    }
+}
+
+inline void addLeaf(float *shape, const uint16_t *leaf, const size_t n) {
+    for (size_t k{}; k < n; ++k) {
+        shape[k] += fromHalf(leaf[k]);
+    }
+}
+
+inline int roundPos(double v) {
+    return static_cast<int>(std::floor(v + 0.5));
+}
+
+} // namespace unnamed
+
+ShapeModel::ShapeModel(const QString &fname) : _file(fname) {
+    if (!_file.open(QIODevice::ReadOnly) || _file.size() < static_cast<qint64>(sizeof(Header))) {
+        return;
+    }
+    const uchar *data = _file.map(0, _file.size());
+    if (!data) {
+        std::cout << "Could not map " << fname.toStdString() << std::endl;
+        return;
+    }
+    const Header *hdr = reinterpret_cast<const Header*>(data);
+    Header expected(*hdr);
+    layout(expected);
+    if (0 != std::memcmp(hdr->magic, Magic, sizeof(Magic)) || (Version != hdr->version && VersionHalf != hdr->version) || 0 != std::memcmp(hdr, &expected, sizeof(Header))
+        || static_cast<qint64>(hdr->fileSize) != _file.size()) {
+        std::cout << "Invalid shape model " << fname.toStdString() << std::endl;
+        return;
+    }
+    _initialShape = reinterpret_cast<const float*>(data + hdr->offInitialShape);
+    _anchors = reinterpret_cast<const uint32_t*>(data + hdr->offAnchors);
+    _deltas = reinterpret_cast<const float*>(data + hdr->offDeltas);
+    if (VersionHalf == hdr->version) {
+        _halfSplits = reinterpret_cast<const HalfSplit*>(data + hdr->offSplits);
+        _halfLeaves = reinterpret_cast<const uint16_t*>(data + hdr->offLeaves);
+    }
+    else {
+        _splits = reinterpret_cast<const Split*>(data + hdr->offSplits);
+        _leaves = reinterpret_cast<const float*>(data + hdr->offLeaves);
+    }
+    _hdr = hdr;
+}
+
+CPointFArray ShapeModel::fit(const QImage &img, const QRect &rect) const {
+    CPointFArray pts;
+    if (!_hdr || 32 != img.depth()) {
+        return pts;
+    }
+    const uint32_t numParts{_hdr->numParts};
+    std::vector<float> shape(_initialShape, _initialShape + 2 * static_cast<size_t>(numParts));
+    if (_halfSplits) {
+        fitShape(img, rect, _halfSplits, _halfLeaves, shape);
+    }
+    else {
+        fitShape(img, rect, _splits, _leaves, shape);
+    }
+    const double left{static_cast<double>(rect.left())}, top{static_cast<double>(rect.top())};
+    const double sx{static_cast<double>(rect.right() - rect.left())}, sy{static_cast<double>(rect.bottom() - rect.top())};
+    pts.reserve(numParts);
+    for (uint32_t i{}; i < numParts; ++i) {
+        pts.emplace_back(roundPos(left + shape[2 * i] * sx), roundPos(top + shape[2 * i + 1] * sy));
+    }
+    return pts;
+}
+
+// features are integer intensity differences, so an integer threshold splits exactly like the float one
+template<typename S, typename L>
+void ShapeModel::fitShape(const QImage &img, const QRect &rect, const S *split, const L *leaves, std::vector<float> &shape) const {
+    const uint32_t numParts{_hdr->numParts}, numFeatures{_hdr->numFeatures}, numSplits{_hdr->numSplits};
+    const size_t leafSize{2 * static_cast<size_t>(numParts)};
+    const double left{static_cast<double>(rect.left())}, top{static_cast<double>(rect.top())};
+    const double sx{static_cast<double>(rect.right() - rect.left())}, sy{static_cast<double>(rect.bottom() - rect.top())};
+    const int width{img.width()}, height{img.height()};
+
+    std::vector<float> features(numFeatures), xs(numFeatures), ys(numFeatures);
+    for (uint32_t c{}; c < _hdr->numCascades; ++c) {
+        float a{}, b{};
+        similarity(_initialShape, shape.data(), numParts, a, b);
+        const uint32_t *anchors = _anchors + static_cast<size_t>(c) * numFeatures;
+        const float *deltas = _deltas + 2 * static_cast<size_t>(c) * numFeatures;
+        featurePositions(shape.data(), anchors, deltas, numFeatures, a, b, xs.data(), ys.data());
+        for (uint32_t i{}; i < numFeatures; ++i) {
+            const int x{roundPos(left + xs[i] * sx)};
+            const int y{roundPos(top + ys[i] * sy)};
+            if (x >= 0 && y >= 0 && x < width && y < height) {
+                const QRgb px{reinterpret_cast<const QRgb*>(img.constScanLine(y))[x]};
+                features[i] = static_cast<float>((qRed(px) + qGreen(px) + qBlue(px)) / 3);
+            }
+            else {
+                features[i] = 0;
+            }
+        }
+        for (uint32_t t{}; t < _hdr->numTrees; ++t, split += numSplits, leaves += (numSplits + 1) * leafSize) {
+            uint32_t n{};
+            while (n < numSplits) {
+                n = features[split[n].idx1] - features[split[n].idx2] > split[n].thresh ? 2 * n + 1 : 2 * n + 2;
+            }
+            addLeaf(shape.data(), leaves + (n - numSplits) * leafSize, leafSize);
+        }
+    }
+}
+
+bool ShapeModel::convert(const QString &datFile, const QString &binFile, bool bHalf) {
+    dlib::matrix<float, 0, 1> initial_shape;
+    std::vector<std::vector<dlib::impl::regression_tree>> forests;
+    std::vector<std::vector<unsigned long>> anchor_idx;
+    std::vector<std::vector<dlib::vector<float, 2>>> deltas;
+    try {
+        // same field order as dlib's serialize(const shape_predictor&)
+        std::ifstream in(datFile.toStdString().c_str(), std::ios::binary);
+        int version{};
+        dlib::deserialize(version, in);
+        if (1 != version) {
+            std::cout << "Unsupported shape_predictor version " << version << std::endl;
+            return false;
+        }
+        dlib::deserialize(initial_shape, in);
+        dlib::deserialize(forests, in);
+        dlib::deserialize(anchor_idx, in);
+        dlib::deserialize(deltas, in);
+    }
+    catch (const dlib::serialization_error &e) {
+        std::cout << "Could not read " << datFile.toStdString() << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    Header hdr{};
+    std::memcpy(hdr.magic, Magic, sizeof(Magic));
+    hdr.version = bHalf ? VersionHalf : Version;
+    hdr.numParts = static_cast<uint32_t>(initial_shape.size() / 2);
+    hdr.numCascades = static_cast<uint32_t>(forests.size());
+    hdr.numTrees = forests.empty() ? 0 : static_cast<uint32_t>(forests[0].size());
+    hdr.numSplits = hdr.numTrees ? static_cast<uint32_t>(forests[0][0].splits.size()) : 0;
+    hdr.numFeatures = anchor_idx.empty() ? 0 : static_cast<uint32_t>(anchor_idx[0].size());
+    bool bUniform{hdr.numParts > 0 && hdr.numCascades > 0 && anchor_idx.size() == hdr.numCascades && deltas.size() == hdr.numCascades && hdr.numFeatures <= 0x10000};
+    for (uint32_t c{}; bUniform && c < hdr.numCascades; ++c) {
+        bUniform = forests[c].size() == hdr.numTrees && anchor_idx[c].size() == hdr.numFeatures && deltas[c].size() == hdr.numFeatures;
+        for (const auto &tree : forests[c]) {
+            bUniform = bUniform && tree.splits.size() == hdr.numSplits && tree.leaf_values.size() == hdr.numSplits + 1;
+            for (const auto &s : tree.splits) {
+                bUniform = bUniform && s.idx1 < hdr.numFeatures && s.idx2 < hdr.numFeatures;
+            }
+        }
+        for (const auto idx : anchor_idx[c]) {
+            bUniform = bUniform && idx < hdr.numParts;
+        }
+    }
+    if (!bUniform) {
+        std::cout << "Shape predictor trees are not uniform, can't flatten" << std::endl;
+        return false;
+    }
+    layout(hdr);
+
+    std::vector<char> buf(hdr.fileSize);
+    std::memcpy(buf.data(), &hdr, sizeof(hdr));
+    std::memcpy(buf.data() + hdr.offInitialShape, &initial_shape(0), 2 * hdr.numParts * sizeof(float));
+    uint32_t *anchors = reinterpret_cast<uint32_t*>(buf.data() + hdr.offAnchors);
+    float *pDeltas = reinterpret_cast<float*>(buf.data() + hdr.offDeltas);
+    Split *splits = reinterpret_cast<Split*>(buf.data() + hdr.offSplits);
+    float *leaves = reinterpret_cast<float*>(buf.data() + hdr.offLeaves);
+    HalfSplit *halfSplits = reinterpret_cast<HalfSplit*>(buf.data() + hdr.offSplits);
+    uint16_t *halfLeaves = reinterpret_cast<uint16_t*>(buf.data() + hdr.offLeaves);
+    double maxError{}, sumError{}, maxLeaf{};
+    for (uint32_t c{}; c < hdr.numCascades; ++c) {
+        for (uint32_t i{}; i < hdr.numFeatures; ++i) {
+            *anchors++ = static_cast<uint32_t>(anchor_idx[c][i]);
+            *pDeltas++ = deltas[c][i].x();
+            *pDeltas++ = deltas[c][i].y();
+        }
+        for (const auto &tree : forests[c]) {
+            for (const auto &s : tree.splits) {
+                if (bHalf) {
+                    // differences of 8-bit intensities lie in [-255, 255]
+                    const float thresh{std::min(std::max(std::floor(s.thresh), -256.f), 255.f)};
+                    *halfSplits++ = HalfSplit{static_cast<uint16_t>(s.idx1), static_cast<uint16_t>(s.idx2), static_cast<int16_t>(thresh)};
+                }
+                else {
+                    *splits++ = Split{static_cast<uint16_t>(s.idx1), static_cast<uint16_t>(s.idx2), s.thresh};
+                }
+            }
+            for (const auto &leaf : tree.leaf_values) {
+                if (bHalf) {
+                    for (uint32_t k{}; k < 2 * hdr.numParts; ++k) {
+                        *halfLeaves = toHalf(leaf(k));
+                        const double err{std::fabs(static_cast<double>(fromHalf(*halfLeaves++)) - leaf(k))};
+                        maxError = std::max(maxError, err);
+                        sumError += err;
+                        maxLeaf = std::max(maxLeaf, std::fabs(static_cast<double>(leaf(k))));
+                    }
+                }
+                else {
+                    std::memcpy(leaves, &leaf(0), 2 * hdr.numParts * sizeof(float));
+                    leaves += 2 * hdr.numParts;
+                }
+            }
+        }
+    }
+
+    std::fstream file(binFile.toStdString().c_str(), std::fstream::out | std::fstream::binary);
+    if (!file.is_open() || !file.write(buf.data(), buf.size())) {
+        std::cout << "Could not write " << binFile.toStdString() << std::endl;
+        return false;
+    }
+    std::cout << "Shape model: " << hdr.numParts << " parts, " << hdr.numCascades << " cascades x " << hdr.numTrees << " trees, " << hdr.fileSize << " bytes" << std::endl;
+    if (bHalf) {
+        Header full(hdr);
+        full.version = Version;
+        layout(full);
+        const double values{static_cast<double>(hdr.numCascades) * hdr.numTrees * (hdr.numSplits + 1) * 2 * hdr.numParts};
+        // leaf values are offsets in face-box units, 1e-3 is a tenth of a pixel on a 100 pixel face
+        std::cout << "Quantized: " << 100. * hdr.fileSize / full.fileSize << "% of the float model (" << full.fileSize << " bytes), thresholds exact, leaf error max "
+                  << maxError << " mean " << sumError / values << " (largest leaf value " << maxLeaf << ")" << std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef SHAPEMODEL_H
+#define SHAPEMODEL_H
+
+#include "base.h"
+#include <QFile>
+#include <QImage>
+#include <cstdint>
+#include <vector>
+
+// Flat binary layout of a dlib shape_predictor, every section is 64-byte aligned
+// and used in place from a read-only memory mapping.
+//
+// header | initial shape | anchors | deltas | splits | leaf values
+//
+// fit() runs in float32, with SSE2 feature positions and leaf updates where available.
+// Version 2 files hold integer split thresholds and float16 leaf values, half the size.
+class ShapeModel final {
+public:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t numParts;
+        uint32_t numCascades;
+        uint32_t numTrees;
+        uint32_t numSplits;
+        uint32_t numFeatures;
+        uint64_t offInitialShape;
+        uint64_t offAnchors;
+        uint64_t offDeltas;
+        uint64_t offSplits;
+        uint64_t offLeaves;
+        uint64_t fileSize;
+    };
+    struct Split {
+        uint16_t idx1, idx2;
+        float thresh;
+    };
+    struct HalfSplit {
+        uint16_t idx1, idx2;
+        int16_t thresh;
+    };
+
+    explicit ShapeModel(const QString &fname);
+    ShapeModel(const ShapeModel &) = delete;
+    ShapeModel& operator=(const ShapeModel &) = delete;
+
+    bool isValid() const {
+        return nullptr != _hdr;
+    }
+    size_t getPartsCount() const {
+        return _hdr ? _hdr->numParts : 0;
+    }
+    size_t getModelSize() const {
+        return _hdr ? _hdr->fileSize : 0;
+    }
+    CPointFArray fit(const QImage &img, const QRect &rect) const;
+
+    static bool convert(const QString &datFile, const QString &binFile, bool bHalf = false);
+
+private:
+    template<typename S, typename L>
+    void fitShape(const QImage &img, const QRect &rect, const S *split, const L *leaves, std::vector<float> &shape) const;
+
+    QFile _file;
+    const Header *_hdr = nullptr;
+    const float *_initialShape = nullptr;
+    const uint32_t *_anchors = nullptr;
+    const float *_deltas = nullptr;
+    const Split *_splits = nullptr;
+    const float *_leaves = nullptr;
+    const HalfSplit *_halfSplits = nullptr;
+    const uint16_t *_halfLeaves = nullptr;
+};
+
+#endif // SHAPEMODEL_H
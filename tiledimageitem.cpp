@@ -0,0 +1,202 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "tiledimageitem.h"
+
+#include <QImageReader>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QThread>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace
+{
+
+constexpr int MaxTileCacheKb{192 * 1024};
+// file regions queued at once, more are asked for as these arrive
+constexpr int MaxPendingTiles{8};
+
+quint64 tileKey(int level, int tx, int ty) {
+    return (static_cast<quint64>(level) << 48) | (static_cast<quint64>(ty) << 24) | static_cast<quint64>(tx);
+}
+
+} // namespace unnamed
+
+PyramidBuilder::PyramidBuilder(const QImage &img, int tileSize, std::shared_ptr<std::atomic<bool>> cancel) : _img(img), _tileSize(tileSize), _bCancel(std::move(cancel))
+{ }
+
+void PyramidBuilder::process() {
+    QImage cur{_img};
+    _img = QImage();
+    for (int level{1}; !*_bCancel && (cur.width() > _tileSize || cur.height() > _tileSize); ++level) {
+        cur = cur.scaled(std::max(1, cur.width() / 2), std::max(1, cur.height() / 2), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        emit levelReady(level, cur);
+    }
+    emit finished();
+}
+
+TileLoader::TileLoader(const QString &fname) : _fname(fname)
+{ }
+
+void TileLoader::load(quint64 key, const QRect &clip, const QSize &scaled) {
+    QImageReader reader(_fname);
+    reader.setClipRect(clip);
+    reader.setScaledSize(scaled);
+    emit tileLoaded(key, reader.read());
+}
+
+TiledImageItem::TiledImageItem(const QImage &img, QGraphicsItem *parent) : QGraphicsObject(parent), _size(img.size()), _levels{img}, _tiles(MaxTileCacheKb),
+    _bBuildCancel(std::make_shared<std::atomic<bool>>(false))
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+
+    auto safeBuilder = std::make_unique<PyramidBuilder>(img, TileSize, _bBuildCancel);
+    QThread *thread = new QThread();
+    PyramidBuilder *builder = safeBuilder.release();
+    builder->moveToThread(thread);
+
+    connect(thread, &QThread::started, builder, &PyramidBuilder::process);
+    connect(builder, &PyramidBuilder::finished, thread, &QThread::quit);
+    connect(builder, &PyramidBuilder::levelReady, this, &TiledImageItem::sltLevel);
+    connect(builder, &PyramidBuilder::finished, builder, &PyramidBuilder::deleteLater);
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+
+    thread->start(QThread::LowPriority);
+}
+
+TiledImageItem::TiledImageItem(const QString &fname, const QSize &size, const QImage &preview, QGraphicsItem *parent) : QGraphicsObject(parent), _size(size), _tiles(MaxTileCacheKb), _preview(QPixmap::fromImage(preview))
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);
+
+    auto safeLoader = std::make_unique<TileLoader>(fname);
+    QThread *thread = new QThread();
+    TileLoader *loader = safeLoader.release();
+    loader->moveToThread(thread);
+    _loaderThread = thread;
+
+    connect(this, &TiledImageItem::requestTile, loader, &TileLoader::load);
+    connect(loader, &TileLoader::tileLoaded, this, &TiledImageItem::sltTile);
+    connect(thread, &QThread::finished, loader, &TileLoader::deleteLater);
+    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+
+    thread->start(QThread::LowPriority);
+}
+
+TiledImageItem::~TiledImageItem()
+{
+    if (_bBuildCancel) {
+        *_bBuildCancel = true;
+    }
+    // queued requests are dropped with the loader's event loop
+    if (_loaderThread) {
+        _loaderThread->quit();
+    }
+}
+
+QRectF TiledImageItem::boundingRect() const {
+    return QRectF(QPointF(), _size);
+}
+
+void TiledImageItem::sltLevel(int level, const QImage &img) {
+    // levels come in order, each one halves the previous
+    if (static_cast<size_t>(level) == _levels.size()) {
+        _levels.push_back(img);
+        update();
+    }
+}
+
+void TiledImageItem::sltTile(quint64 key, const QImage &img) {
+    _pending.remove(key);
+    if (img.isNull()) {
+        _failed.insert(key);
+    }
+    else {
+        QPixmap *pm = new QPixmap(QPixmap::fromImage(img));
+        _tiles.insert(key, pm, std::max(1, pm->width() * pm->height() * pm->depth() / 8 / 1024));
+    }
+    // a freed request slot lets the next tile in view be asked for
+    update();
+}
+
+const QPixmap* TiledImageItem::tile(int level, int tx, int ty) {
+    const quint64 key{tileKey(level, tx, ty)};
+    if (const QPixmap *pm = _tiles.object(key)) {
+        return pm;
+    }
+    const QImage &img = _levels[level];
+    const QRect r{QRect(tx * TileSize, ty * TileSize, TileSize, TileSize).intersected(img.rect())};
+    QPixmap *pm = new QPixmap(QPixmap::fromImage(img.copy(r)));
+    const int cost{std::max(1, pm->width() * pm->height() * pm->depth() / 8 / 1024)};
+    return _tiles.insert(key, pm, cost) ? pm : nullptr;
+}
+
+void TiledImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+    // level 0 is full resolution, each next one halves it
+    const qreal lod{option->levelOfDetailFromTransform(painter->worldTransform())};
+    const int wanted{lod >= 1. ? 0 : static_cast<int>(std::floor(std::log2(1. / lod)))};
+    const QRectF exposed{option->exposedRect.intersected(boundingRect())};
+    if (_levels.empty()) {
+        paintFile(painter, exposed, wanted);
+    }
+    else {
+        paintLevels(painter, exposed, wanted);
+    }
+}
+
+void TiledImageItem::paintLevels(QPainter *painter, const QRectF &exposed, int wanted) {
+    // finest level that is still no larger than needed at this zoom, or the finest built so far
+    const int level{std::min(wanted, static_cast<int>(_levels.size()) - 1)};
+    const QImage &img = _levels[level];
+    const qreal sx{static_cast<qreal>(_size.width()) / img.width()};
+    const qreal sy{static_cast<qreal>(_size.height()) / img.height()};
+
+    const int tx0{std::max(0, static_cast<int>(exposed.left() / sx) / TileSize)};
+    const int ty0{std::max(0, static_cast<int>(exposed.top() / sy) / TileSize)};
+    const int tx1{std::min((img.width() - 1) / TileSize, static_cast<int>(exposed.right() / sx) / TileSize)};
+    const int ty1{std::min((img.height() - 1) / TileSize, static_cast<int>(exposed.bottom() / sy) / TileSize)};
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, level > 0);
+    for (int ty{ty0}; ty <= ty1; ++ty) {
+        for (int tx{tx0}; tx <= tx1; ++tx) {
+            if (const QPixmap *pm = tile(level, tx, ty)) {
+                const QRectF target(tx * TileSize * sx, ty * TileSize * sy, pm->width() * sx, pm->height() * sy);
+                painter->drawPixmap(target, *pm, QRectF(pm->rect()));
+            }
+        }
+    }
+}
+
+void TiledImageItem::paintFile(QPainter *painter, const QRectF &exposed, int wanted) {
+    // the preview stands in for every level it is fine enough for, and under tiles still loading
+    const qreal px{static_cast<qreal>(_preview.width()) / _size.width()}, py{static_cast<qreal>(_preview.height()) / _size.height()};
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
+    painter->drawPixmap(exposed, _preview, QRectF(exposed.left() * px, exposed.top() * py, exposed.width() * px, exposed.height() * py));
+    const int step{1 << std::min(wanted, 16)};
+    if (step * px >= 1.) {
+        return;
+    }
+
+    const int span{FileTileSize * step};
+    const int tx0{std::max(0, static_cast<int>(exposed.left()) / span)};
+    const int ty0{std::max(0, static_cast<int>(exposed.top()) / span)};
+    const int tx1{std::min((_size.width() - 1) / span, static_cast<int>(exposed.right()) / span)};
+    const int ty1{std::min((_size.height() - 1) / span, static_cast<int>(exposed.bottom()) / span)};
+    for (int ty{ty0}; ty <= ty1; ++ty) {
+        for (int tx{tx0}; tx <= tx1; ++tx) {
+            const QRect clip{QRect(tx * span, ty * span, span, span).intersected(QRect(QPoint(), _size))};
+            const quint64 key{tileKey(wanted, tx, ty)};
+            if (const QPixmap *pm = _tiles.object(key)) {
+                painter->drawPixmap(QRectF(clip), *pm, QRectF(pm->rect()));
+            }
+            else if (!_pending.contains(key) && !_failed.contains(key) && _pending.size() < MaxPendingTiles) {
+                _pending.insert(key);
+                emit requestTile(key, clip, QSize(std::max(1, clip.width() / step), std::max(1, clip.height() / step)));
+            }
+        }
+    }
+}
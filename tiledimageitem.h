@@ -0,0 +1,111 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef TILEDIMAGEITEM_H
+#define TILEDIMAGEITEM_H
+
+#include <QCache>
+#include <QGraphicsObject>
+#include <QImage>
+#include <QPixmap>
+#include <QPointer>
+#include <QSet>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class QThread;
+
+// Halves an image again and again on its own thread until it fits in one tile.
+// The cancel flag is shared with the owner, which may be gone before the builder.
+class PyramidBuilder : public QObject
+{
+    Q_OBJECT
+
+public:
+    PyramidBuilder(const QImage &img, int tileSize, std::shared_ptr<std::atomic<bool>> cancel);
+
+public slots:
+    void process();
+
+signals:
+    void levelReady(int level, const QImage &img);
+    void finished();
+
+private:
+    QImage _img;
+    int _tileSize;
+    std::shared_ptr<std::atomic<bool>> _bCancel;
+};
+
+// Decodes full resolution regions of an image file, optionally downscaled,
+// through QImageReader clip rects. Requests are served in order on its thread.
+class TileLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TileLoader(const QString &fname);
+
+public slots:
+    void load(quint64 key, const QRect &clip, const QSize &scaled);
+
+signals:
+    void tileLoaded(quint64 key, const QImage &img);
+
+private:
+    QString _fname;
+};
+
+// Image item for very large stills. Only the tiles in the exposed area are
+// turned into pixmaps, from the pyramid level closest to the view scale;
+// tiles live in a bounded cache and the coarser levels are built in background.
+// Built from a file and its preview, the item shows the preview and decodes
+// only the regions in view from the file once the zoom outgrows the preview.
+class TiledImageItem : public QGraphicsObject
+{
+    Q_OBJECT
+
+public:
+    enum { Type = UserType + 6 };
+    static constexpr int TileSize{256};
+    static constexpr int FileTileSize{1024};
+
+    explicit TiledImageItem(const QImage &img, QGraphicsItem *parent = nullptr);
+    TiledImageItem(const QString &fname, const QSize &size, const QImage &preview, QGraphicsItem *parent = nullptr);
+    ~TiledImageItem() Q_DECL_OVERRIDE;
+
+    QRectF boundingRect() const Q_DECL_OVERRIDE;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) Q_DECL_OVERRIDE;
+    int type() const Q_DECL_OVERRIDE {
+        return Type;
+    }
+
+signals:
+    void requestTile(quint64 key, const QRect &clip, const QSize &scaled);
+
+private slots:
+    void sltLevel(int level, const QImage &img);
+    void sltTile(quint64 key, const QImage &img);
+
+private:
+    const QPixmap* tile(int level, int tx, int ty);
+    void paintLevels(QPainter *painter, const QRectF &exposed, int wanted);
+    void paintFile(QPainter *painter, const QRectF &exposed, int wanted);
+
+    QSize _size;
+    std::vector<QImage> _levels;
+    // cost is in kilobytes
+    QCache<quint64, QPixmap> _tiles;
+    std::shared_ptr<std::atomic<bool>> _bBuildCancel;
+
+    QPixmap _preview;
+    QSet<quint64> _pending;
+    // regions the file would not decode, the preview stays in their place
+    QSet<quint64> _failed;
+    QPointer<QThread> _loaderThread;
+};
+
+#endif // TILEDIMAGEITEM_H
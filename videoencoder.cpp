@@ -0,0 +1,153 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "videoencoder.h"
+#include "ffmpegdriver.h"
+
+#include <QImage>
+
+#include <iostream>
+
+namespace
+{
+
+// BT.601 limited range in 8-bit fixed point, chroma from the mean of each 2x2 block;
+// width and height are even
+void bgr_to_yuv420(const uint8_t * const pBGR, const uint32_t bgr_stride, uint8_t * const pY, const uint32_t y_stride, uint8_t * const pU, const uint32_t u_stride, uint8_t * const pV, const uint32_t v_stride, const uint32_t width, const uint32_t height) {
+    for (uint32_t y{}; y < height; y += 2) {
+        const uint8_t *src0 = pBGR + y * bgr_stride, *src1 = src0 + bgr_stride;
+        uint8_t *y0 = pY + y * y_stride, *y1 = y0 + y_stride;
+        uint8_t *u = pU + (y / 2) * u_stride, *v = pV + (y / 2) * v_stride;
+        for (uint32_t x{}; x < width; x += 2, src0 += 8, src1 += 8) {
+            int sumR{}, sumG{}, sumB{};
+            const uint8_t *px[4] = {src0, src0 + 4, src1, src1 + 4};
+            uint8_t *dst[4] = {y0 + x, y0 + x + 1, y1 + x, y1 + x + 1};
+            for (int i{}; i < 4; ++i) {
+                const int B{px[i][0]}, G{px[i][1]}, R{px[i][2]};
+                *dst[i] = static_cast<uint8_t>(((66 * R + 129 * G + 25 * B + 128) >> 8) + 16);
+                sumR += R;
+                sumG += G;
+                sumB += B;
+            }
+            *u++ = static_cast<uint8_t>(((-38 * sumR - 74 * sumG + 112 * sumB + 512) >> 10) + 128);
+            *v++ = static_cast<uint8_t>(((112 * sumR - 94 * sumG - 18 * sumB + 512) >> 10) + 128);
+        }
+    }
+}
+
+} // namespace unnamed
+
+VideoEncoder::VideoEncoder(const char *fname, int width, int height, int fps_num, int fps_den) {
+    if (AVFormatDll::getInstance().p_avformat_alloc_output_context2(&fmt_ctx_, nullptr, nullptr, fname) < 0 || !fmt_ctx_) {
+        std::cout << "Could not deduce output format from " << fname << std::endl;
+        return;
+    }
+    AVCodec *codec = AVCodecDll::getInstance().p_avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    if (!codec) {
+        std::cout << "MPEG-4 encoder not found" << std::endl;
+        return;
+    }
+    stream_ = AVFormatDll::getInstance().p_avformat_new_stream(fmt_ctx_, nullptr);
+    enc_ctx_ = AVCodecDll::getInstance().p_avcodec_alloc_context3(codec);
+    if (!stream_ || !enc_ctx_) {
+        std::cout << "Failed to allocate encoder" << std::endl;
+        return;
+    }
+    // 4:2:0 needs even dimensions, an odd last row or column is dropped
+    enc_ctx_->width = width & ~1;
+    enc_ctx_->height = height & ~1;
+    enc_ctx_->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc_ctx_->time_base = AVRational{fps_den, fps_num};
+    enc_ctx_->framerate = AVRational{fps_num, fps_den};
+    enc_ctx_->gop_size = 12;
+    enc_ctx_->flags |= AV_CODEC_FLAG_QSCALE;
+    enc_ctx_->global_quality = FF_QP2LAMBDA * 3;
+    if (fmt_ctx_->oformat->flags & AVFMT_GLOBALHEADER) {
+        enc_ctx_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    stream_->time_base = enc_ctx_->time_base;
+    if (AVCodecDll::getInstance().p_avcodec_open2(enc_ctx_, codec, nullptr) < 0
+        || AVCodecDll::getInstance().p_avcodec_parameters_from_context(stream_->codecpar, enc_ctx_) < 0) {
+        std::cout << "Failed to open MPEG-4 encoder" << std::endl;
+        return;
+    }
+    if (AVFormatDll::getInstance().p_avio_open(&fmt_ctx_->pb, fname, AVIO_FLAG_WRITE) < 0) {
+        std::cout << "Could not open " << fname << std::endl;
+        return;
+    }
+    if (AVFormatDll::getInstance().p_avformat_write_header(fmt_ctx_, nullptr) < 0) {
+        std::cout << "Could not write header of " << fname << std::endl;
+        AVFormatDll::getInstance().p_avio_closep(&fmt_ctx_->pb);
+        return;
+    }
+    frame_ = AVUtilDll::getInstance().p_av_frame_alloc();
+    frame_->format = enc_ctx_->pix_fmt;
+    frame_->width = enc_ctx_->width;
+    frame_->height = enc_ctx_->height;
+    if (AVUtilDll::getInstance().p_av_frame_get_buffer(frame_, 32) < 0) {
+        std::cout << "Failed to allocate frame" << std::endl;
+        AVFormatDll::getInstance().p_avio_closep(&fmt_ctx_->pb);
+        return;
+    }
+    bOpen_ = true;
+}
+
+VideoEncoder::~VideoEncoder() {
+    if (bOpen_) {
+        encode(nullptr);
+        AVFormatDll::getInstance().p_av_write_trailer(fmt_ctx_);
+        AVFormatDll::getInstance().p_avio_closep(&fmt_ctx_->pb);
+    }
+    AVUtilDll::getInstance().p_av_frame_free(&frame_);
+    AVCodecDll::getInstance().p_avcodec_free_context(&enc_ctx_);
+    AVFormatDll::getInstance().p_avformat_free_context(fmt_ctx_);
+}
+
+bool VideoEncoder::writeFrame(const QImage &img) {
+    if (!bOpen_ || 32 != img.depth() || img.width() < frame_->width || img.height() < frame_->height) {
+        return false;
+    }
+    // the encoder may still reference the previous buffer
+    if (AVUtilDll::getInstance().p_av_frame_make_writable(frame_) < 0) {
+        return false;
+    }
+    bgr_to_yuv420(img.constBits(), img.bytesPerLine(), frame_->data[0], frame_->linesize[0], frame_->data[1], frame_->linesize[1], frame_->data[2], frame_->linesize[2], frame_->width, frame_->height);
+    frame_->pts = next_pts_++;
+    return encode(frame_);
+}
+
+bool VideoEncoder::encode(const AVFrame *frame) {
+    char buf[AV_ERROR_MAX_STRING_SIZE] = { };
+    int ret = AVCodecDll::getInstance().p_avcodec_send_frame(enc_ctx_, frame);
+    if (ret < 0) {
+        AVUtilDll::getInstance().p_av_strerror(ret, buf, AV_ERROR_MAX_STRING_SIZE);
+        std::cout << "Error while sending a frame to the encoder: " << buf << std::endl;
+        return false;
+    }
+    while (ret >= 0) {
+        AVPacket pkt;
+        AVCodecDll::getInstance().p_av_init_packet(&pkt);
+        pkt.data = nullptr;
+        pkt.size = 0;
+        ret = AVCodecDll::getInstance().p_avcodec_receive_packet(enc_ctx_, &pkt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret < 0) {
+            AVUtilDll::getInstance().p_av_strerror(ret, buf, AV_ERROR_MAX_STRING_SIZE);
+            std::cout << "Error while encoding: " << buf << std::endl;
+            return false;
+        }
+        AVCodecDll::getInstance().p_av_packet_rescale_ts(&pkt, enc_ctx_->time_base, stream_->time_base);
+        pkt.stream_index = stream_->index;
+        // takes ownership of the packet data
+        ret = AVFormatDll::getInstance().p_av_interleaved_write_frame(fmt_ctx_, &pkt);
+        if (ret < 0) {
+            std::cout << "Error while writing a packet" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef VIDEOENCODER_H
+#define VIDEOENCODER_H
+
+#include <cstdint>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct AVStream;
+class QImage;
+
+// MPEG-4 part 2 writer on top of the dynamically loaded FFmpeg libraries,
+// frames have to be written in presentation order
+class VideoEncoder final {
+public:
+    VideoEncoder(const char *fname, int width, int height, int fps_num, int fps_den);
+    ~VideoEncoder();
+    VideoEncoder(const VideoEncoder &) = delete;
+    VideoEncoder& operator=(const VideoEncoder &) = delete;
+
+    bool isOpen() const {
+        return bOpen_;
+    }
+    bool writeFrame(const QImage &img);
+
+private:
+    bool encode(const AVFrame *frame);
+
+    AVFormatContext *fmt_ctx_ = nullptr;
+    AVCodecContext *enc_ctx_ = nullptr;
+    AVStream *stream_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    int64_t next_pts_ = 0;
+    bool bOpen_ = false;
+};
+
+#endif // VIDEOENCODER_H
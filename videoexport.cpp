@@ -0,0 +1,115 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#include "videoexport.h"
+#include "batchjob.h"
+#include "overlay.h"
+#include "videoencoder.h"
+#include "videostream.h"
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+VideoExport::VideoExport(const QString &fname, const QString &outName, double scale) : _fname(fname), _outName(outName), _scale(scale)
+{ }
+
+void VideoExport::cancel()
+{
+    _bCancel.store(true, std::memory_order_relaxed);
+}
+
+void VideoExport::process()
+{
+    QElapsedTimer timer;
+    timer.start();
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+    // frames decoded but not yet encoded, bounds the reorder buffer
+    const int window{2 * pool.maxThreadCount()};
+
+    VideoStream stream(_fname.toStdString().c_str());
+    // frames are decoded upright, HOG finds no faces in sideways footage
+    stream.setRotation(_turns);
+    const QSize size{static_cast<int>(stream.getWidth()), static_cast<int>(stream.getHeight())};
+    const QSize upright{0 != (_turns & 1) ? size.transposed() : size};
+    int fpsNum{}, fpsDen{};
+    stream.getFrameRate(fpsNum, fpsDen);
+    VideoEncoder encoder(_outName.toStdString().c_str(), upright.width(), upright.height(), fpsNum, fpsDen);
+    if (!stream.isValid()) {
+        emit failed(tr("Cannot open %1").arg(_fname));
+    }
+    else if (!encoder.isOpen()) {
+        emit failed(tr("Cannot write %1").arg(_outName));
+    }
+
+    std::mutex guard;
+    std::condition_variable cond;
+    std::map<int, QImage> ready;
+    int submitted{}, encoded{};
+    // encodes the frames that are next in order, optionally waiting for the first one
+    auto drain = [&](bool bWait) {
+        std::unique_lock<std::mutex> lock(guard);
+        if (bWait) {
+            cond.wait(lock, [&]{ return ready.count(encoded) > 0; });
+        }
+        for (auto it = ready.find(encoded); it != ready.end(); it = ready.find(encoded)) {
+            const QImage img{std::move(it->second)};
+            ready.erase(it);
+            lock.unlock();
+            encoder.writeFrame(img);
+            emit progress(++encoded);
+            lock.lock();
+        }
+    };
+
+    while (stream.isValid() && encoder.isOpen() && !_bCancel.load(std::memory_order_relaxed)) {
+        QImage img(upright, QImage::Format::Format_RGB32);
+        if (!stream.getNextFrame(img)) {
+            break;
+        }
+        while (submitted - encoded >= window) {
+            drain(true);
+        }
+        const int seq{submitted++};
+        pool.start(new BatchTask([this, img, seq, &guard, &cond, &ready]() mutable {
+            CRectArray faces;
+            CPointFArray points;
+            if (!_bCancel.load(std::memory_order_relaxed)) {
+                BatchTask::detect(img, _scale, faces, points);
+                QPainter painter(&img);
+                painter.setRenderHint(QPainter::Antialiasing, true);
+                painter.setPen(QPen(Qt::green, 1));
+                drawOverlay(painter, mapperPt(QPoint(), QPointF(), QPointF(1., 1.)), faces, points);
+            }
+            else {
+                // still handed over so the reorder buffer drains, the encoder skips it
+                img = QImage();
+            }
+            {
+                std::lock_guard<std::mutex> lock(guard);
+                ready.emplace(seq, std::move(img));
+            }
+            cond.notify_one();
+        }));
+        drain(false);
+    }
+    while (encoded < submitted) {
+        drain(true);
+    }
+    pool.waitForDone();
+
+    const double seconds{timer.elapsed() / 1000.};
+    std::cout << "Export: " << encoded << " frames in " << seconds << " s, " << (seconds > 0. ? encoded / seconds : 0.) << " fps" << std::endl;
+    emit finished(encoded, seconds);
+}
@@ -0,0 +1,44 @@
+/**
+ * The MIT License (MIT)
+ * Copyright (c) 2017-2018 Kirill Lebedev
+**/
+
+#ifndef VIDEOEXPORT_H
+#define VIDEOEXPORT_H
+
+#include <QObject>
+#include <QString>
+#include <atomic>
+
+// Re-encodes a video with its faces and landmarks drawn on every frame.
+// Decoding and encoding run on the job's own thread, detection and drawing
+// on a pool; finished frames are put back in order before the encoder.
+class VideoExport : public QObject
+{
+    Q_OBJECT
+
+public:
+    VideoExport(const QString &fname, const QString &outName, double scale);
+    void cancel();
+    // the output is written turned clockwise by quarterTurns * 90 degrees, as the view shows it
+    void setRotation(int quarterTurns) {
+        _turns = quarterTurns & 3;
+    }
+
+public slots:
+    void process();
+
+signals:
+    void progress(int frames);
+    // sent before finished when the source or the output could not be opened
+    void failed(const QString &reason);
+    void finished(int frames, double seconds);
+
+private:
+    QString _fname, _outName;
+    double _scale;
+    int _turns{};
+    std::atomic<bool> _bCancel{false};
+};
+
+#endif // VIDEOEXPORT_H
@@ -13,8 +13,10 @@
 namespace
 {
 
+// pHalf optionally receives a half resolution copy, each 2x2 luma block
+// is averaged and shares the chroma sample, so it is nearly free here
 template<typename trait>
-bool decode_yuv(uint8_t * const pRGB, const uint32_t rgb_stride, const uint8_t * const pY, const uint32_t y_stride, const uint8_t * const pU, const uint32_t u_stride, const uint8_t * const pV, const uint32_t v_stride, const uint32_t width, const uint32_t height, const uint8_t alpha=0xff)
+bool decode_yuv(uint8_t * const pRGB, const uint32_t rgb_stride, const uint8_t * const pY, const uint32_t y_stride, const uint8_t * const pU, const uint32_t u_stride, const uint8_t * const pV, const uint32_t v_stride, const uint32_t width, const uint32_t height, uint8_t * const pHalf = nullptr, const uint32_t half_stride = 0, const uint8_t alpha=0xff)
 {
     if (0!=(width&1) || width<2 || 0!=(height&1) || height<2 || !pRGB || !pY || !pU || !pV)
         return false;
@@ -30,6 +32,7 @@ bool decode_yuv(uint8_t * const pRGB, const uint32_t rgb_stride, const uint8_t *
         const uint8_t *v0 = pV + v_stride * (h >> 1);
         uint8_t *dst0 = pRGB + rgb_stride * h;
         uint8_t *dst1 = dst0 + rgb_stride;
+        uint8_t *dstH = pHalf ? pHalf + half_stride * (h >> 1) : nullptr;
         for (uint32_t w{}; w < width; w += 2) {
             Y00 = std::max((*y0++) - 16, 0) * 298;  Y01 = std::max((*y0++) - 16, 0) * 298;
             Y10 = std::max((*y1++) - 16, 0) * 298;  Y11 = std::max((*y1++) - 16, 0) * 298;
@@ -44,6 +47,80 @@ bool decode_yuv(uint8_t * const pRGB, const uint32_t rgb_stride, const uint8_t *
             trait::store_pixel(dst0, Y01 + tR, Y01 + tG, Y01 + tB, alpha);
             trait::store_pixel(dst1, Y10 + tR, Y10 + tG, Y10 + tB, alpha);
             trait::store_pixel(dst1, Y11 + tR, Y11 + tG, Y11 + tB, alpha);
+            if (dstH) {
+                const int32_t YH{(Y00 + Y01 + Y10 + Y11 + 2) >> 2};
+                trait::store_pixel(dstH, YH + tR, YH + tG, YH + tB, alpha);
+            }
+        }
+    }
+    return true;
+}
+
+// address of the destination pixel for source pixel (x, y) after a clockwise
+// rotation by turns * 90 degrees, width and height are the source dimensions
+template<int turns>
+inline uint8_t* rotated_pixel(uint8_t * const base, const uint32_t stride, const uint32_t x, const uint32_t y, const uint32_t width, const uint32_t height)
+{
+    switch (turns) {
+    case 1:
+        return base + stride * x + 4 * (height - 1 - y);
+    case 2:
+        return base + stride * (height - 1 - y) + 4 * (width - 1 - x);
+    case 3:
+        return base + stride * (width - 1 - x) + 4 * y;
+    default:
+        return base + stride * y + 4 * x;
+    }
+}
+
+// decode_yuv writing straight into the rotated layout. The source is walked in
+// square tiles so the column-wise writes of a tile stay within a few cache lines
+// per destination row instead of striding through the whole frame.
+template<typename trait, int turns>
+bool decode_yuv_rotated(uint8_t * const pRGB, const uint32_t rgb_stride, const uint8_t * const pY, const uint32_t y_stride, const uint8_t * const pU, const uint32_t u_stride, const uint8_t * const pV, const uint32_t v_stride, const uint32_t width, const uint32_t height, uint8_t * const pHalf = nullptr, const uint32_t half_stride = 0, const uint8_t alpha=0xff)
+{
+    if (0!=(width&1) || width<2 || 0!=(height&1) || height<2 || !pRGB || !pY || !pU || !pV)
+        return false;
+
+    constexpr uint32_t Tile{64};
+    int32_t Y00{}, Y01{}, Y10{}, Y11{};
+    int32_t V{}, U{};
+    int32_t tR{}, tG{}, tB{};
+
+    for (uint32_t th{}; th < height; th += Tile) {
+        const uint32_t thEnd{std::min(th + Tile, height)};
+        for (uint32_t tw{}; tw < width; tw += Tile) {
+            const uint32_t twEnd{std::min(tw + Tile, width)};
+            for (uint32_t h{th}; h < thEnd; h += 2) {
+                const uint8_t *y0 = pY + y_stride * h + tw;
+                const uint8_t *y1 = y0 + y_stride;
+                const uint8_t *u0 = pU + u_stride * (h >> 1) + (tw >> 1);
+                const uint8_t *v0 = pV + v_stride * (h >> 1) + (tw >> 1);
+                for (uint32_t w{tw}; w < twEnd; w += 2) {
+                    Y00 = std::max((*y0++) - 16, 0) * 298;  Y01 = std::max((*y0++) - 16, 0) * 298;
+                    Y10 = std::max((*y1++) - 16, 0) * 298;  Y11 = std::max((*y1++) - 16, 0) * 298;
+
+                    trait::loadvu(U, V, u0, v0);
+
+                    tR = 128 + 409 * V;
+                    tG = 128 - 100 * U - 208 * V;
+                    tB = 128 + 516 * U;
+
+                    uint8_t *dst = rotated_pixel<turns>(pRGB, rgb_stride, w, h, width, height);
+                    trait::store_pixel(dst, Y00 + tR, Y00 + tG, Y00 + tB, alpha);
+                    dst = rotated_pixel<turns>(pRGB, rgb_stride, w + 1, h, width, height);
+                    trait::store_pixel(dst, Y01 + tR, Y01 + tG, Y01 + tB, alpha);
+                    dst = rotated_pixel<turns>(pRGB, rgb_stride, w, h + 1, width, height);
+                    trait::store_pixel(dst, Y10 + tR, Y10 + tG, Y10 + tB, alpha);
+                    dst = rotated_pixel<turns>(pRGB, rgb_stride, w + 1, h + 1, width, height);
+                    trait::store_pixel(dst, Y11 + tR, Y11 + tG, Y11 + tB, alpha);
+                    if (pHalf) {
+                        const int32_t YH{(Y00 + Y01 + Y10 + Y11 + 2) >> 2};
+                        dst = rotated_pixel<turns>(pHalf, half_stride, w >> 1, h >> 1, width >> 1, height >> 1);
+                        trait::store_pixel(dst, YH + tR, YH + tG, YH + tB, alpha);
+                    }
+                }
+            }
         }
     }
     return true;
@@ -64,8 +141,17 @@ public:
     }
 };
 
-bool yuv_to_bgr(uint8_t * const pRGB, const uint32_t rgb_stride, const uint8_t * const pY, const uint32_t y_stride, const uint8_t * const pU, const uint32_t u_stride, const uint8_t * const pV, const uint32_t v_stride, const uint32_t width, const uint32_t height) {
-    return decode_yuv<YUVtoBGR>(pRGB, rgb_stride, pY, y_stride, pU, u_stride, pV, v_stride, width, height);
+bool yuv_to_bgr(uint8_t * const pRGB, const uint32_t rgb_stride, const uint8_t * const pY, const uint32_t y_stride, const uint8_t * const pU, const uint32_t u_stride, const uint8_t * const pV, const uint32_t v_stride, const uint32_t width, const uint32_t height, uint8_t * const pHalf, const uint32_t half_stride, const int turns) {
+    switch (turns) {
+    case 1:
+        return decode_yuv_rotated<YUVtoBGR, 1>(pRGB, rgb_stride, pY, y_stride, pU, u_stride, pV, v_stride, width, height, pHalf, half_stride);
+    case 2:
+        return decode_yuv_rotated<YUVtoBGR, 2>(pRGB, rgb_stride, pY, y_stride, pU, u_stride, pV, v_stride, width, height, pHalf, half_stride);
+    case 3:
+        return decode_yuv_rotated<YUVtoBGR, 3>(pRGB, rgb_stride, pY, y_stride, pU, u_stride, pV, v_stride, width, height, pHalf, half_stride);
+    default:
+        return decode_yuv<YUVtoBGR>(pRGB, rgb_stride, pY, y_stride, pU, u_stride, pV, v_stride, width, height, pHalf, half_stride);
+    }
 }
 
 } // namespace unnamed
@@ -73,30 +159,44 @@ bool yuv_to_bgr(uint8_t * const pRGB, const uint32_t rgb_stride, const uint8_t *
 VideoStream::VideoStream(const char *fname) {
     if (AVFormatDll::getInstance().p_avformat_open_input(&fmt_ctx_, fname, nullptr, nullptr) < 0) {
         std::cout << "Could not open source file" << std::endl;
+        return;
     }
     if (AVFormatDll::getInstance().p_avformat_find_stream_info(fmt_ctx_, nullptr) < 0) {
         std::cout << "Could not find stream information" << std::endl;
+        return;
     }
     AVCodec *dec = nullptr;
     int ret = AVFormatDll::getInstance().p_av_find_best_stream(fmt_ctx_, AVMEDIA_TYPE_VIDEO, -1, -1, &dec, 0);
     if (ret < 0) {
         std::cout << "Could not find " << AVUtilDll::getInstance().p_av_get_media_type_string(AVMEDIA_TYPE_VIDEO) << " stream in input file" << std::endl;
+        return;
     }
     video_stream_idx_ = ret;
     AVStream *st = fmt_ctx_->streams[video_stream_idx_];
     total_frame_ = st->nb_frames;
     std::cout << "Frames: " << st->nb_frames << std::endl;
     std::cout << "Start time: " << st->start_time << std::endl;
+    if (AV_NOPTS_VALUE != st->start_time) {
+        start_pts_ = st->start_time;
+    }
+    if (st->avg_frame_rate.num > 0 && st->avg_frame_rate.den > 0 && st->time_base.num > 0) {
+        frame_pts_ = static_cast<double>(st->time_base.den) * st->avg_frame_rate.den / (static_cast<double>(st->time_base.num) * st->avg_frame_rate.num);
+        fps_num_ = st->avg_frame_rate.num;
+        fps_den_ = st->avg_frame_rate.den;
+    }
     video_dec_ctx_ = AVCodecDll::getInstance().p_avcodec_alloc_context3(dec);
     if (!video_dec_ctx_) {
         std::cout << "Failed to allocate codec" << std::endl;
+        return;
     }
     ret = AVCodecDll::getInstance().p_avcodec_parameters_to_context(video_dec_ctx_, st->codecpar);
     if (ret < 0) {
         std::cout << "Failed to copy codec parameters to codec context" << std::endl;
+        return;
     }
     if ((ret = AVCodecDll::getInstance().p_avcodec_open2(video_dec_ctx_, dec, nullptr)) < 0) {
         std::cout << "Failed to open " << AVUtilDll::getInstance().p_av_get_media_type_string(AVMEDIA_TYPE_VIDEO) << " codec" << std::endl;
+        return;
     }
 
     frame_ = AVUtilDll::getInstance().p_av_frame_alloc();
@@ -111,7 +211,7 @@ VideoStream::~VideoStream() {
     AVFormatDll::getInstance().p_avformat_close_input(&fmt_ctx_);
 }
 
-int VideoStream::decode_packet(const AVPacket *pkt, QImage &img) {
+int VideoStream::decode_packet(const AVPacket *pkt, QImage &img, QImage *half) {
     std::cout << "decode_packet" << std::endl;
     char buf[AV_ERROR_MAX_STRING_SIZE] = { };
     int ret = AVCodecDll::getInstance().p_avcodec_send_packet(video_dec_ctx_, pkt);
@@ -137,7 +237,8 @@ int VideoStream::decode_packet(const AVPacket *pkt, QImage &img) {
 
         std::cout << frame_->linesize[0] << " - " << frame_->linesize[1] << " - " << frame_->linesize[2] << std::endl;
         if (AV_PIX_FMT_YUV420P == frame_->format) {
-            yuv_to_bgr(img.bits(), img.bytesPerLine(), frame_->data[0], frame_->linesize[0], frame_->data[1], frame_->linesize[1], frame_->data[2], frame_->linesize[2], frame_->width, frame_->height);
+            yuv_to_bgr(img.bits(), img.bytesPerLine(), frame_->data[0], frame_->linesize[0], frame_->data[1], frame_->linesize[1], frame_->data[2], frame_->linesize[2], frame_->width, frame_->height,
+                half ? half->bits() : nullptr, half ? half->bytesPerLine() : 0, turns_);
         }
 
         //img = new QImage(frame_->data[0], frame_->width, frame_->height, frame_->linesize[0], QImage::Format_Grayscale8);
@@ -152,8 +253,11 @@ int VideoStream::decode_packet(const AVPacket *pkt, QImage &img) {
     return 0;
 }
 
-bool VideoStream::getNextFrame(QImage &img) {
-    assert(this->getWidth() == img.width() && this->getHeight() == img.height());
+bool VideoStream::getNextFrame(QImage &img, QImage *half) {
+    const bool bTransposed{0 != (turns_ & 1)};
+    assert((bTransposed ? this->getHeight() : this->getWidth()) == img.width() && (bTransposed ? this->getWidth() : this->getHeight()) == img.height());
+    assert(!half || (img.width() / 2 == half->width() && img.height() / 2 == half->height()));
+    Q_UNUSED(bTransposed);
     std::cout << "getNextFrame" << std::endl;
     if (frame_) {
         AVPacket pkt = { };
@@ -161,7 +265,7 @@ bool VideoStream::getNextFrame(QImage &img) {
         int res{};
         while (AVFormatDll::getInstance().p_av_read_frame(fmt_ctx_, &pkt) >= 0) {
             if (pkt.stream_index == video_stream_idx_) {
-                res = decode_packet(&pkt, img);
+                res = decode_packet(&pkt, img, half);
             }
             AVCodecDll::getInstance().p_av_packet_unref(&pkt);
             if (1 == res) {
@@ -173,7 +277,7 @@ bool VideoStream::getNextFrame(QImage &img) {
             }
         }
         // flush cached frames
-        decode_packet(&pkt, img);
+        decode_packet(&pkt, img, half);
     }
     else {
         std::cout << "Could not allocate frame" << std::endl;
@@ -184,6 +288,9 @@ bool VideoStream::getNextFrame(QImage &img) {
 
 bool VideoStream::seek(int64_t t) {
     std::cout << "seek" << std::endl;
+    if (!isValid()) {
+        return false;
+    }
     int ret = AVFormatDll::getInstance().p_av_seek_frame(fmt_ctx_, -1, pts_ + t, AVSEEK_FLAG_ANY);
     if (ret < 0) {
         std::cout << "Seek error" << std::endl;
@@ -194,3 +301,17 @@ bool VideoStream::seek(int64_t t) {
     AVCodecDll::getInstance().p_avcodec_flush_buffers(video_dec_ctx_);
     return ret >= 0;
 }
+
+// lands on the key frame at or before pts, callers decode forward to reach it
+bool VideoStream::seekTo(int64_t pts) {
+    std::cout << "seekTo " << pts << std::endl;
+    if (!isValid()) {
+        return false;
+    }
+    int ret = AVFormatDll::getInstance().p_av_seek_frame(fmt_ctx_, video_stream_idx_, pts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        std::cout << "Seek error" << std::endl;
+    }
+    AVCodecDll::getInstance().p_avcodec_flush_buffers(video_dec_ctx_);
+    return ret >= 0;
+}
@@ -18,6 +18,10 @@ class VideoStream final {
 public:
     VideoStream(const char *fname);
     ~VideoStream();
+    // false when the file could not be opened or has no decodable video stream
+    bool isValid() const {
+        return nullptr != frame_;
+    }
     size_t getFramesCount() const {
         return total_frame_;
     }
@@ -27,11 +31,28 @@ public:
     size_t getHeight() const {
         return h_;
     }
-    bool getNextFrame(QImage &img);
+    int64_t getPts() const {
+        return pts_;
+    }
+    void getFrameRate(int &num, int &den) const {
+        num = fps_num_;
+        den = fps_den_;
+    }
+    // pts of the n-th frame assuming a constant frame rate
+    int64_t getFramePts(size_t frame) const {
+        return start_pts_ + static_cast<int64_t>(frame * frame_pts_ + .5);
+    }
+    // frames are converted straight into a layout turned clockwise by quarterTurns * 90
+    // degrees, getNextFrame then expects the rotated image dimensions
+    void setRotation(int quarterTurns) {
+        turns_ = quarterTurns & 3;
+    }
+    bool getNextFrame(QImage &img, QImage *half = nullptr);
     bool seek(int64_t t);
+    bool seekTo(int64_t pts);
 
 private:
-    int decode_packet(const AVPacket *pkt, QImage &img);
+    int decode_packet(const AVPacket *pkt, QImage &img, QImage *half);
 
     AVFormatContext *fmt_ctx_ = nullptr;
     AVCodecContext *video_dec_ctx_ = nullptr;
@@ -39,6 +60,10 @@ private:
     size_t total_frame_ = 0, cur_frame_ = 0, w_ = 0, h_ = 0;
     int video_stream_idx_ = -1;
     int64_t pts_ = -1;
+    int64_t start_pts_ = 0;
+    double frame_pts_ = 1.;
+    int fps_num_ = 25, fps_den_ = 1;
+    int turns_ = 0;
 };
 
 #endif // VIDEOSTREAM_H
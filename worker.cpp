@@ -4,79 +4,167 @@
 **/
 
 #include "worker.h"
-#include <lbf/lbf.hpp>
-#include <dlib/image_processing/frontal_face_detector.h>
-#include <dlib/image_processing/shape_predictor.h>
-
-#include <type_traits>
-
-namespace dlib {
-    struct bgr_alpha_pixel
-    {
-        /*!
-            WHAT THIS OBJECT REPRESENTS
-                This is a simple struct that represents an BGR colored graphical pixel
-                with an alpha channel.
-        !*/
-
-        bgr_alpha_pixel (
-        ) {}
-
-        bgr_alpha_pixel (
-            unsigned char blue_,
-            unsigned char green_,
-            unsigned char red_,
-            unsigned char alpha_
-        ) : blue(blue_), green(green_), red(red_), alpha(alpha_) {}
-
-        unsigned char blue;
-        unsigned char green;
-        unsigned char red;
-        unsigned char alpha;
-    };
+#include "dlibimage.h"
+#include "engines.h"
+#include "imagerotate.h"
+#include <QImageReader>
+#include <dlib/array2d.h>
+#include <dlib/image_processing/correlation_tracker.h>
+#include <dlib/image_transforms/assign_image.h>
 
-    template <>
-    struct pixel_traits<bgr_alpha_pixel>
-    {
-        const static bool rgb  = false;
-        const static bool rgb_alpha  = true;
-        const static bool grayscale = false;
-        const static bool hsi = false;
-        const static bool lab = false;
-        enum {num = 4};
-        typedef unsigned char basic_pixel_type;
-        static basic_pixel_type min() { return 0;}
-        static basic_pixel_type max() { return 255;}
-        const static bool is_unsigned = true;
-        const static bool has_alpha = true;
-    };
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <mutex>
 
-    template <>
-    struct image_traits<QImage>
-    {
-        typedef dlib::bgr_alpha_pixel pixel_type;
-    };
+namespace {
+
+// HOG detector window is 80x80, smaller crops can't contain a face
+constexpr int MinRegionSize{100};
+// peak-to-sidelobe ratio below which a correlation track is considered lost
+constexpr double MinTrackConfidence{7.};
+
+QRect expandRegion(const QRect &r, const QRect &bounds) {
+    const int dx{std::max(r.width() / 2, (MinRegionSize - r.width() + 1) / 2)};
+    const int dy{std::max(r.height() / 2, (MinRegionSize - r.height() + 1) / 2)};
+    return r.adjusted(-dx, -dy, dx, dy).intersected(bounds);
+}
 
-    const void* image_data(const QImage &img) {
-        return img.bits();
+// expanded regions, overlapping ones are united so no pixel is scanned twice
+CRectArray mergeRegions(const CRectArray &regions, const QRect &bounds) {
+    CRectArray res;
+    for (const auto &e : regions) {
+        QRect r{expandRegion(e, bounds)};
+        if (r.isEmpty()) {
+            continue;
+        }
+        for (bool bMerged{true}; bMerged;) {
+            bMerged = false;
+            for (auto it = res.begin(); it != res.end(); ++it) {
+                if (it->intersects(r)) {
+                    r = r.united(*it);
+                    res.erase(it);
+                    bMerged = true;
+                    break;
+                }
+            }
+        }
+        res.push_back(r);
     }
-    long width_step(const QImage &img) {
-        return img.bytesPerLine();
+    return res;
+}
+
+CRectArray detectFaces(const FaceEngine &engine, const QImage &image, const CRectArray &regions, const std::function<bool()> &isCancelled) {
+    if (regions.empty()) {
+        return engine.detect(image);
     }
-    long num_rows(const QImage &img) {
-        return img.height();
+    CRectArray dets;
+    for (const auto &r : mergeRegions(regions, image.rect())) {
+        if (isCancelled()) {
+            break;
+        }
+        // shallow view into the frame, only the crop itself is converted
+        const QImage crop(image.constBits() + r.top() * image.bytesPerLine() + r.left() * 4, r.width(), r.height(), image.bytesPerLine(), image.format());
+        const CRectArray roiDets{engine.detect(crop)};
+        std::transform(roiDets.cbegin(), roiDets.cend(), std::back_inserter(dets), [&r](const auto &e){ return e.translated(r.topLeft()); });
+    }
+    return dets;
+}
+
+// detect on a downscaled copy, rectangles are mapped back to full resolution
+CRectArray detectFaces(const FaceEngine &engine, const QImage &image, const QImage &small, const CRectArray &regions, const std::function<bool()> &isCancelled) {
+    if (small.isNull() || small.size() == image.size()) {
+        return detectFaces(engine, image, regions, isCancelled);
+    }
+    const double sx{static_cast<double>(image.width()) / small.width()}, sy{static_cast<double>(image.height()) / small.height()};
+    CRectArray smallRegions;
+    smallRegions.reserve(regions.size());
+    std::transform(regions.cbegin(), regions.cend(), std::back_inserter(smallRegions), [sx, sy](const auto &e){
+        return QRect(QPoint(static_cast<int>(std::floor(e.left() / sx)), static_cast<int>(std::floor(e.top() / sy))),
+                     QPoint(static_cast<int>(std::ceil(e.right() / sx)), static_cast<int>(std::ceil(e.bottom() / sy))));
+    });
+    CRectArray dets{detectFaces(engine, small, smallRegions, isCancelled)};
+    for (auto &d : dets) {
+        d = QRect(QPoint(qRound(d.left() * sx), qRound(d.top() * sy)), QPoint(qRound((d.right() + 1) * sx) - 1, qRound((d.bottom() + 1) * sy) - 1));
     }
-    long num_columns(const QImage &img) {
-        return img.width();
+    return dets;
+}
+
+// Landmarks of a face found on the preview of a large still, fitted on a full
+// resolution crop of the file. The result is in preview coordinates like a fit
+// on the preview itself, but keeps the full resolution precision.
+CPointFArray refineLandmarks(const LandmarkEngine &engine, const QString &fname, const QTransform &view, int turns, double previewScale, const QRect &face) {
+    const QRect full{QRectF(face.x() / previewScale, face.y() / previewScale, face.width() / previewScale, face.height() / previewScale).toAlignedRect()};
+    // room around the box for the shape to spread beyond it
+    const QRect padded{full.adjusted(-full.width() / 2, -full.height() / 2, full.width() / 2, full.height() / 2)};
+    QImageReader reader(fname);
+    const QRect clip{view.inverted().mapRect(padded).intersected(QRect(QPoint(), reader.size()))};
+    if (clip.isEmpty()) {
+        return CPointFArray();
+    }
+    reader.setClipRect(clip);
+    QImage crop{reader.read()};
+    if (crop.isNull()) {
+        std::cout << "Cannot read " << fname.toStdString() << ": " << reader.errorString().toStdString() << std::endl;
+        return CPointFArray();
+    }
+    crop = rotateImage(32 == crop.depth() && !crop.hasAlphaChannel() ? crop : crop.convertToFormat(QImage::Format_RGB32), turns);
+    const QPoint origin{view.mapRect(clip).topLeft()};
+    CPointFArray pts{engine.fit(crop, full.translated(-origin))};
+    for (auto &pt : pts) {
+        pt = (pt + origin) * previewScale;
+    }
+    return pts;
+}
+
+} // namespace unnamed
+
+CRectArray findFaces(const QImage &img, double scale)
+{
+    const QImage image{32 == img.depth() && !img.hasAlphaChannel() ? img : img.convertToFormat(QImage::Format_RGB32)};
+    const QImage small{scale < 1. ? image.scaled(image.size() * scale, Qt::IgnoreAspectRatio, Qt::SmoothTransformation) : QImage()};
+    return detectFaces(faceEngine(), image, small, CRectArray(), []{ return false; });
+}
+
+CPointFArray findLandmarks(const QImage &img, const QRect &rect)
+{
+    const QImage image{32 == img.depth() && !img.hasAlphaChannel() ? img : img.convertToFormat(QImage::Format_RGB32)};
+    return landmarkEngine().fit(image, rect);
+}
+
+struct FaceTracker::Impl
+{
+    void start(const dlib::array2d<dlib::rgb_pixel> &img, const CRectArray &dets) {
+        trackers.assign(dets.size(), dlib::correlation_tracker());
+        for (size_t i{}; i < dets.size(); ++i) {
+            trackers[i].start_track(img, dlib::rectangle(dets[i].left(), dets[i].top(), dets[i].right(), dets[i].bottom()));
+        }
     }
-} // namespace dlib
+
+    std::mutex mutex;
+    std::vector<dlib::correlation_tracker> trackers;
+};
+
+FaceTracker::FaceTracker() : _impl(std::make_unique<Impl>())
+{ }
+
+FaceTracker::~FaceTracker() = default;
+
+void FaceTracker::reset()
+{
+    std::lock_guard<std::mutex> lock(_impl->mutex);
+    _impl->trackers.clear();
+}
 
 TWorker::TWorker(workerType type) : _type(type)
 { }
 
 void TWorker::setData(const QImage &img)
 {
-    _image = img;
+    // detectors read the buffer in place as opaque 32-bit BGRA, only other formats are converted
+    _image = 32 == img.depth() && !img.hasAlphaChannel() ? img : img.convertToFormat(QImage::Format_RGB32);
 }
 
 void TWorker::setRect(const QRect &rect)
@@ -84,90 +172,135 @@ void TWorker::setRect(const QRect &rect)
     _rect = rect;
 }
 
+void TWorker::setRegions(const CRectArray &regions)
+{
+    _regions = regions;
+}
+
+void TWorker::setTracker(const std::shared_ptr<FaceTracker> &tracker)
+{
+    _tracker = tracker;
+}
+
+void TWorker::setTicket(const std::shared_ptr<JobTicket> &ticket)
+{
+    _ticket = ticket;
+    _job = ticket->issue();
+}
+
+void TWorker::setDetectionScale(double scale, const QImage &small)
+{
+    _scale = std::min(std::max(scale, 0.05), 1.);
+    _small = small.isNull() || (32 == small.depth() && !small.hasAlphaChannel()) ? small : small.convertToFormat(QImage::Format_RGB32);
+}
+
+void TWorker::setSource(const QString &fname, const QTransform &view, int quarterTurns, double previewScale)
+{
+    _source = fname;
+    _view = view;
+    _turns = quarterTurns;
+    _previewScale = previewScale;
+}
+
+void TWorker::setEngine(const QString &name)
+{
+    _engine = name;
+}
+
+const QImage& TWorker::detectionImage()
+{
+    if (_scale < 1. && _small.isNull()) {
+        _small = _image.scaled(_image.size() * _scale, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return _small;
+}
+
+bool TWorker::isCancelled() const
+{
+    return _ticket && !_ticket->isCurrent(_job);
+}
+
 void TWorker::process()
 {
     switch (_type) {
-    case workerType::wtFaceDetector:
+    case workerType::wtWarmUp:
+        faceEngine();
+        landmarkEngine();
+        break;
+    case workerType::wtLoadEngine:
         {
-            dlib::array2d<dlib::rgb_pixel> img;
-            dlib::assign_image(img, _image);
-            dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
-            std::vector<dlib::rectangle> dets = detector(img);
-            CRectArray frects;
-            if (!dets.empty()) {
-                std::transform(dets.cbegin(), dets.cend(), std::back_inserter(frects), [](const auto &e){ return QRect(e.left(), e.top(), e.width(), e. height()); });
-            }
-            emit completeFaceDetector(frects);
+            const LandmarkEngine *engine = findLandmarkEngine(_engine);
+            emit engineLoaded(engine && engine->isValid());
         }
         break;
-    case workerType::wtLBFRDetector:
-#if 0
+    case workerType::wtFaceDetector:
         {
-            std::vector<dlib::rectangle> dets;
-            if (_rect.isEmpty()) {
-                std::cout << "Rect isEmpty" << std::endl;
+            CRectArray frects = detectFaces(faceEngine(), _image, detectionImage(), _regions, std::bind(&TWorker::isCancelled, this));
+            if (isCancelled()) {
+                break;
+            }
+            if (_tracker) {
                 dlib::array2d<dlib::rgb_pixel> img;
                 dlib::assign_image(img, _image);
-                dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
-                dets = detector(img);
+                std::lock_guard<std::mutex> lock(_tracker->_impl->mutex);
+                _tracker->_impl->start(img, frects);
             }
-            else {
-                dets.push_back(dlib::rectangle(_rect.left(), _rect.top(), _rect.right(), _rect.bottom()));
+            emit completeFaceDetector(frects, _job);
+        }
+        break;
+    case workerType::wtFaceTracker:
+        {
+            dlib::array2d<dlib::rgb_pixel> img;
+            dlib::assign_image(img, _image);
+            CRectArray frects;
+            std::lock_guard<std::mutex> lock(_tracker->_impl->mutex);
+            // trackers advance on a copy, the shared ones change only for a job that is still current
+            auto trackers = _tracker->_impl->trackers;
+            bool bLost{trackers.empty()};
+            for (auto it = trackers.begin(); !bLost && it != trackers.end() && !isCancelled(); ++it) {
+                bLost = it->update(img) < MinTrackConfidence;
+            }
+            if (isCancelled()) {
+                break;
             }
-            if (!dets.empty()) {
-                auto imgGr = _image.convertToFormat(QImage::Format_Grayscale8);
-                lbf::LbfCascador lbfr;
-                std::unique_ptr<std::FILE, decltype(&std::fclose)> fp(std::fopen("ibug_helen_dlib_full_model", "rb"), &std::fclose);
-                lbfr.Read(fp.get());
-                cv::Mat mcopy = cv::Mat(imgGr.height(), imgGr.width(), CV_8UC1, imgGr.bits(), imgGr.bytesPerLine()).clone();
-                //cv::cvtColor(mcopy, mcopy, CV_BGRA2Gray);
-                lbf::BBox bbox(dets[0].left(), dets[0].top(), dets[0].width(), dets[0].height());
-                auto res = lbfr.Predict(mcopy, bbox);
-                std::vector<QPointF> pts;
-                pts.reserve(res.rows);
-                for (int y(0); y < res.rows; ++y) {
-                    pts.emplace_back(res.at<double>(y, 0), res.at<double>(y, 1));
+            if (bLost) {
+                frects = detectFaces(faceEngine(), _image, detectionImage(), _regions, std::bind(&TWorker::isCancelled, this));
+                if (isCancelled()) {
+                    break;
                 }
-                emit completeLBFRDetector(pts);
+                _tracker->_impl->start(img, frects);
+            }
+            else {
+                _tracker->_impl->trackers = std::move(trackers);
+                const auto &current = _tracker->_impl->trackers;
+                std::transform(current.cbegin(), current.cend(), std::back_inserter(frects), [](const auto &e){
+                    const dlib::rectangle r(e.get_position());
+                    return QRect(r.left(), r.top(), r.width(), r.height());
+                });
+            }
+            if (isCancelled()) {
+                break;
             }
+            emit completeFaceDetector(frects, _job);
         }
-#else
+        break;
+    case workerType::wtLBFRDetector:
         {
-            std::vector<dlib::rectangle> dets;
-            dlib::array2d<dlib::rgb_pixel> img;
-            dlib::assign_image(img, _image);
-            if (_rect.isEmpty()) {
+            QRect face{_rect};
+            if (face.isEmpty()) {
                 std::cout << "Rect isEmpty" << std::endl;
-                dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
-                dets = detector(img);
+                const CRectArray frects{detectFaces(faceEngine(), _image, detectionImage(), _regions, std::bind(&TWorker::isCancelled, this))};
+                face = frects.empty() ? QRect() : frects.front();
             }
-            else {
-                dets.push_back(dlib::rectangle(_rect.left(), _rect.top(), _rect.right(), _rect.bottom()));
+            if (isCancelled()) {
+                break;
             }
-            if (!dets.empty()) {
-                static const dlib::shape_predictor sp = []{
-                    dlib::shape_predictor tmp;
-                    dlib::deserialize("shape_predictor_68_face_landmarks.dat") >> tmp;
-                    return tmp;
-                }();
-                //static dlib::shape_predictor sp;
-                //static bool bFirst = true;
-                //if (bFirst) {
-                //    dlib::deserialize("shape_predictor_68_face_landmarks.dat") >> sp;
-                //    bFirst = false;
-                //}
-                dlib::full_object_detection shape = sp(img, dets[0]);
-                std::vector<QPointF> pts;
-                const auto sz{shape.num_parts()};
-                pts.reserve(sz);
-                for (std::remove_const_t<decltype(sz)> i{}; i < sz; ++i) {
-                    const auto &pt = shape.part(i);
-                    pts.emplace_back(pt.x(), pt.y());
-                }
-                emit completeLBFRDetector(pts);
+            if (!face.isEmpty()) {
+                const LandmarkEngine &engine = landmarkEngine();
+                CPointFArray pts = _source.isEmpty() ? engine.fit(_image, face) : refineLandmarks(engine, _source, _view, _turns, _previewScale, face);
+                emit completeLBFRDetector(pts, _job);
             }
         }
-#endif
         break;
     };
     emit finished();
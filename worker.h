@@ -9,9 +9,51 @@
 #include "base.h"
 #include <QObject>
 #include <QImage>
+#include <QTransform>
+#include <atomic>
+#include <memory>
 
 //#include <dlib/image_processing/frontal_face_detector.h>
 
+class TWorker;
+
+// synchronous detection for batch jobs, safe to call from any thread
+CRectArray findFaces(const QImage &img, double scale = 1.);
+CPointFArray findLandmarks(const QImage &img, const QRect &rect);
+
+// Latest-wins tag shared by the GUI and all detection jobs of one kind,
+// issuing a new job or revoking the ticket supersedes every earlier job
+class JobTicket
+{
+public:
+    quint64 issue() {
+        return ++_latest;
+    }
+    void revoke() {
+        ++_latest;
+    }
+    bool isCurrent(quint64 job) const {
+        return job == _latest.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<quint64> _latest{0};
+};
+
+// Correlation trackers that follow faces between detector keyframes
+class FaceTracker
+{
+public:
+    FaceTracker();
+    ~FaceTracker();
+    void reset();
+
+private:
+    friend class TWorker;
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
 class TWorker : public QObject
 {
     Q_OBJECT
@@ -19,13 +61,25 @@ class TWorker : public QObject
 public:
     enum class workerType {
         wtFaceDetector = 1,
-        wtLBFRDetector = 2
+        wtLBFRDetector = 2,
+        wtFaceTracker = 3,
+        wtWarmUp = 4,
+        wtLoadEngine = 5
 
     };
 
     TWorker(workerType type);
     void setData(const QImage &img);
     void setRect(const QRect &rect);
+    void setRegions(const CRectArray &regions);
+    void setTracker(const std::shared_ptr<FaceTracker> &tracker);
+    void setTicket(const std::shared_ptr<JobTicket> &ticket);
+    void setDetectionScale(double scale, const QImage &small = QImage());
+    // the data is the preview of this file, shown through view at full resolution
+    void setSource(const QString &fname, const QTransform &view, int quarterTurns, double previewScale);
+    // landmark engine wtLoadEngine loads
+    void setEngine(const QString &name);
+    bool isCancelled() const;
 
 public slots:
     void process();
@@ -33,12 +87,24 @@ public slots:
 signals:
     void finished();
     void noMemory();
-    void completeFaceDetector(CRectArray &frects);
-    void completeLBFRDetector(CPointFArray &pts);
+    void completeFaceDetector(CRectArray &frects, quint64 job);
+    void completeLBFRDetector(CPointFArray &pts, quint64 job);
+    void engineLoaded(bool bValid);
 
 private:
-    QImage _image;
+    const QImage& detectionImage();
+
+    QImage _image, _small;
+    double _scale = 1.;
     QRect _rect;
+    CRectArray _regions;
+    QString _source, _engine;
+    QTransform _view;
+    int _turns = 0;
+    double _previewScale = 1.;
+    std::shared_ptr<FaceTracker> _tracker;
+    std::shared_ptr<JobTicket> _ticket;
+    quint64 _job = 0;
     workerType _type;
 };
 